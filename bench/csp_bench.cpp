@@ -0,0 +1,264 @@
+#include <string.h>
+
+#include <chrono>
+
+#include "../examples/nqueens.h"
+#include "../examples/sudoku.h"
+#include "../examples/tiles.h"
+
+/* Benchmark of the solver on the instance families of the examples. Every
+ * instance is built from a fixed seed, so the results of different versions
+ * of the solver can be compared. Prints one record per workload, as JSON or
+ * CSV. Build with optimizations, e.g. -DCMAKE_BUILD_TYPE=Release. */
+
+struct bench_result {
+    char         workload[64] = {};
+    int          instances    = 0;
+    int          solved       = 0;  // or solutions, for counting workloads
+    double       seconds      = 0;
+    search_stats stats        = {};
+    size_t       peak_bytes   = 0;  // on the stack, during the searches
+};
+
+enum bench_format { JSON, CSV };
+
+inline double seconds_now() {
+    auto now = std::chrono::steady_clock::now().time_since_epoch();
+    return std::chrono::duration<double>(now).count();
+}
+
+// Same as search(), without building the solution or printing anything.
+bool solve(const CSP& csp, const search_options& options, search_stats& stats) {
+    stack_frame();
+    auto S = make_search_state(csp, options);
+    schedule_all(S);
+    bool solved = constraints_propagation(S) and search_with_restarts(S, stats);
+    stats.propagations += S.propagations;
+    return solved;
+}
+
+// Time a run of a workload, and measure the memory it takes on the stack.
+template <typename Run>
+void measure(bench_result& result, const Run& run) {
+    auto& stack = default_allocator();
+    auto  head  = stack.head;
+    stack.peak  = head;
+    auto  start = seconds_now();
+    run();
+    result.seconds += seconds_now() - start;
+    result.instances += 1;
+    if (stack.peak - head > result.peak_bytes)
+        result.peak_bytes = stack.peak - head;
+}
+
+void print_result(const bench_result& r, bench_format format, bool first) {
+    auto& s          = r.stats;
+    auto  per_second = r.seconds > 0 ? s.expansions / r.seconds : 0.0;
+    if (format == CSV) {
+        if (first)
+            printf("workload,instances,solved,seconds,nodes_per_second,"
+                   "expansions,backtracks,propagations,peak_arena_bytes\n");
+        printf("%s,%d,%d,%.6f,%.0f,%lld,%lld,%lld,%zu\n", r.workload, r.instances,
+               r.solved, r.seconds, per_second, s.expansions, s.backtracks,
+               s.propagations, r.peak_bytes);
+    } else {
+        printf(first ? "[\n" : ",\n");
+        printf("  {\"workload\": \"%s\", \"instances\": %d, \"solved\": %d, "
+               "\"seconds\": %.6f, \"nodes_per_second\": %.0f, "
+               "\"expansions\": %lld, \"backtracks\": %lld, "
+               "\"propagations\": %lld, \"peak_arena_bytes\": %zu}",
+               r.workload, r.instances, r.solved, r.seconds, per_second,
+               s.expansions, s.backtracks, s.propagations, r.peak_bytes);
+    }
+    fflush(stdout);
+}
+
+// First solution of N-queens, with seeds 0 to num_seeds - 1.
+bench_result bench_nqueens(int N, int num_seeds) {
+    stack_frame();
+    auto result = bench_result{};
+    snprintf(result.workload, sizeof(result.workload), "nqueens-%d", N);
+    auto csp = make_nqueens(N);
+    for (int seed = 0; seed < num_seeds; ++seed) {
+        auto options = search_options{};
+        options.seed = seed;
+        measure(result, [&]() {
+            result.solved += solve(csp, options, result.stats);
+        });
+    }
+    return result;
+}
+
+// All the solutions of N-queens.
+bench_result bench_nqueens_count(int N) {
+    stack_frame();
+    auto result = bench_result{};
+    snprintf(result.workload, sizeof(result.workload), "nqueens-count-%d", N);
+    auto csp                = make_nqueens(N);
+    auto options            = enumerate_options{};
+    options.check_solutions = false;
+    measure(result, [&]() {
+        result.solved += enumerate_solutions(csp, options, result.stats);
+    });
+    return result;
+}
+
+inline long long count_solutions(const CSP& csp, long long max_solutions) {
+    auto options            = enumerate_options{};
+    options.max_solutions   = max_solutions;
+    options.check_solutions = false;
+    auto stats              = search_stats{};
+    return enumerate_solutions(csp, options, stats);
+}
+
+// Sudoku from a random full grid, whose clues are removed in random order.
+// With min_clues 0, clues are removed only while the solution stays unique,
+// otherwise down to min_clues, keeping the puzzle solvable.
+array<Domain> make_sudoku_puzzle(CSP& sudoku, int N, uint64_t seed,
+                                 int min_clues) {
+    int  cells  = N * N * N * N;
+    auto values = allocate<int>(cells, 0);
+    auto random = make_rng(seed);
+    {
+        stack_frame();
+        auto options = search_options{};
+        options.seed = seed;
+        auto stats   = search_stats{};
+        auto S       = make_search_state(sudoku, options);
+        schedule_all(S);
+        constraints_propagation(S);
+        search(S, 0, stats);
+        for (int i = 0; i < cells; ++i) values[i] = S.domains[i].value();
+    }
+
+    auto domains   = allocate<Domain>(cells);
+    auto set_clues = [&]() {
+        for (int i = 0; i < cells; ++i) {
+            domains[i] = make_domain(1, N * N + 1);
+            if (values[i] != 0) fix(domains[i], values[i]);
+        }
+    };
+    auto order = make_range(cells);
+    shuffle(order, random);
+    int clues = cells;
+    for (int cell : order) {
+        if (min_clues > 0 and clues <= min_clues) break;
+        stack_frame();
+        int value    = values[cell];
+        values[cell] = 0;
+        clues -= 1;
+        if (min_clues > 0) continue;
+        set_clues();
+        auto puzzle    = sudoku;
+        puzzle.domains = domains;
+        if (count_solutions(puzzle, 2) == 1) continue;
+        values[cell] = value;
+        clues += 1;
+    }
+    set_clues();
+    return domains;
+}
+
+// Sudokus with seeds 0 to num_puzzles - 1, plus the hard one of the example
+// for 9x9.
+bench_result bench_sudoku(int N, int num_puzzles, int min_clues) {
+    stack_frame();
+    auto result = bench_result{};
+    snprintf(result.workload, sizeof(result.workload), "sudoku-%dx%d",
+             N * N, N * N);
+    auto csp          = make_sudoku(N);
+    auto empty        = csp.domains;
+    auto solve_puzzle = [&](const array<Domain>& puzzle) {
+        csp.domains = puzzle;
+        measure(result, [&]() {
+            result.solved += solve(csp, {}, result.stats);
+        });
+    };
+    if (N == 3) solve_puzzle(make_sudoku_hard());
+    for (int seed = 0; seed < num_puzzles; ++seed) {
+        csp.domains = empty;
+        solve_puzzle(make_sudoku_puzzle(csp, N, seed, min_clues));
+    }
+    return result;
+}
+
+struct sudoku_batch {
+    array<array<Domain>> puzzles;
+    int                  solved = 0;
+};
+
+// The generated sudokus of bench_sudoku(), without the hard one, solved by
+// solve_batch() on one thread instead of one search each.
+bench_result bench_sudoku_batch(int N, int num_puzzles, int min_clues) {
+    stack_frame();
+    auto result = bench_result{};
+    snprintf(result.workload, sizeof(result.workload), "sudoku-%dx%d-batch",
+             N * N, N * N);
+    auto csp   = make_sudoku(N);
+    auto empty = csp.domains;
+    auto batch = sudoku_batch{};
+    batch.puzzles = allocate<array<Domain>>(num_puzzles);
+    for (int seed = 0; seed < num_puzzles; ++seed) {
+        csp.domains         = empty;
+        batch.puzzles[seed] = make_sudoku_puzzle(csp, N, seed, min_clues);
+    }
+    csp.domains = empty;
+
+    auto options         = batch_options{};
+    options.data         = &batch;
+    options.get_instance = [](long long i, array<Domain>& domains,
+                              void* data) {
+        auto& puzzles = ((sudoku_batch*)data)->puzzles;
+        if (i >= puzzles.count) return false;
+        copy_to(puzzles[i], domains);
+        return true;
+    };
+    options.on_solution = [](long long, const Assignment& solution,
+                             void* data) {
+        if (solution.count > 0) ((sudoku_batch*)data)->solved += 1;
+    };
+    measure(result, [&]() { solve_batch(csp, options, result.stats); });
+    // The searches run on the arenas of the workers, not on the stack.
+    result.peak_bytes = result.stats.peak_memory;
+    result.instances  = num_puzzles;
+    result.solved     = batch.solved;
+    return result;
+}
+
+// Tileable grids of N by N tiles, with seeds 0 to num_seeds - 1.
+bench_result bench_tiles(int N, int num_seeds) {
+    stack_frame();
+    auto result = bench_result{};
+    snprintf(result.workload, sizeof(result.workload), "tiles-%d", N);
+    auto csp = make_tiles(N, true);
+    for (int seed = 0; seed < num_seeds; ++seed) {
+        auto options = search_options{};
+        options.seed = seed;
+        measure(result, [&]() {
+            result.solved += solve(csp, options, result.stats);
+        });
+    }
+    return result;
+}
+
+// Usage: csp_bench [json|csv]
+int main(int argc, char const* argv[]) {
+    auto format = JSON;
+    if (argc >= 2 and strcmp(argv[1], "csv") == 0) format = CSV;
+
+    auto arena          = memory_arena(1 << 20);
+    default_allocator() = stack_allocator{&arena, 0};
+
+    bool first  = true;
+    auto report = [&](const bench_result& result) {
+        print_result(result, format, first);
+        first = false;
+    };
+    for (int N : {8, 16, 32, 64, 128}) report(bench_nqueens(N, 5));
+    for (int N : {8, 10, 12}) report(bench_nqueens_count(N));
+    report(bench_sudoku(3, 20, 0));
+    report(bench_sudoku_batch(3, 20, 0));
+    report(bench_sudoku(4, 10, 90));
+    for (int N : {9, 16, 24, 32}) report(bench_tiles(N, 5));
+    if (format == JSON) printf("\n]\n");
+}
@@ -1,14 +1,91 @@
 #include "csp.h"
 
-bool satisfies(const array<Constraint>& C, const array<Domain>& D) {
+#include <string.h>
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+bool satisfies(const array<Constraint>& C, const array<Domain>& D,
+               stack_allocator& stack) {
     for (auto& constraint : C) {
-        if (not eval(constraint, D)) {
+        if (not eval(constraint, D, stack)) {
             return false;
         }
     }
     return true;
 }
 
+// Check a complete assignment at a leaf of the search.
+static bool check_leaf(search_state& S) {
+    profile_cycles(S.profile.check_cycles);
+    return satisfies(S.csp->constraints, S.domains, *S.stack);
+}
+
+// Record the depth of a node of the search.
+static void visit_node(search_state& S, int depth) {
+#if CSP_PROFILE
+    if (depth > S.profile.max_depth) S.profile.max_depth = depth;
+#else
+    (void)S, (void)depth;
+#endif
+}
+
+// With CSP_PROFILE, make room for the counters of each constraint in the
+// statistics, which outlive the search.
+static void reserve_profile(search_stats& stats, const CSP& csp,
+                            stack_allocator& stack) {
+#if CSP_PROFILE
+    auto& wipeouts = stats.profile.wipeouts;
+    if (wipeouts.count == csp.constraints.count) return;
+    wipeouts = allocate<int>(csp.constraints.count, 0, stack);
+#else
+    (void)stats, (void)csp, (void)stack;
+#endif
+}
+
+static void add_profile(search_profile& to, const search_profile& from) {
+#if CSP_PROFILE
+    for (int t = 0; t < search_profile::num_types; ++t) {
+        to.propagations[t] += from.propagations[t];
+        to.removals[t] += from.removals[t];
+    }
+    if (to.wipeouts.count == from.wipeouts.count)
+        for (int c = 0; c < to.wipeouts.count; ++c)
+            to.wipeouts[c] += from.wipeouts[c];
+    if (from.max_depth > to.max_depth) to.max_depth = from.max_depth;
+    to.heuristic_cycles += from.heuristic_cycles;
+    to.propagate_cycles += from.propagate_cycles;
+    to.check_cycles += from.check_cycles;
+#else
+    (void)to, (void)from;
+#endif
+}
+
+// Add the counters kept by a search state to the statistics, and write the
+// rest of its trace.
+static void finish_state(search_stats& stats, search_state& S) {
+    if (S.options.trace) flush_trace(S);
+    stats.propagations += S.propagations;
+    if (S.stack->peak > stats.peak_memory) stats.peak_memory = S.stack->peak;
+    add_profile(stats.profile, S.profile);
+}
+
+// Add the statistics of a worker to the total.
+static void add_stats(search_stats& to, const search_stats& from) {
+    to.backtracks += from.backtracks;
+    to.expansions += from.expansions;
+    to.restarts += from.restarts;
+    to.propagations += from.propagations;
+    if (from.peak_memory > to.peak_memory) to.peak_memory = from.peak_memory;
+    add_profile(to.profile, from.profile);
+}
+
 bool is_assignment_complete(const array<Domain>& D) {
     for (int i = 0; i < D.size(); ++i)
         if (D[i].size() != 1) return false;
@@ -16,14 +93,21 @@ bool is_assignment_complete(const array<Domain>& D) {
     return true;
 }
 
-bool do_inferences(const array<Constraint>& C, array<Domain>& D) {
-    // Forward propagation.
-    if (not constraints_propagation(C, D)) {
-        return false;
+bool do_inferences(search_state& S) {
+    // Forward propagation, alternated with the one of the objective and of
+    // the learned nogoods until none of them changes a domain.
+    while (true) {
+        if (not constraints_propagation(S)) return false;
+        int trail = S.trail.count;
+        if (S.objective and not propagate_objective(S)) return false;
+        if (S.conflict.count > 0 and not propagate_nogoods(S)) return false;
+        if (S.trail.count == trail) break;
     }
 
-    // Generalized arc consistency.
-    // if (not gac3(C, D)) {
+    // Arc consistency of binary constraints is maintained by their
+    // propagators, with residual supports. The generic gac3() is much slower
+    // and stays disabled.
+    // if (not gac3(S)) {
     //     comment("GAC3 failure");
     // return false;
     // }
@@ -31,67 +115,228 @@ bool do_inferences(const array<Constraint>& C, array<Domain>& D) {
     return true;
 }
 
-bool search(const array<Constraint>& C, array<Domain>& D, int depth,
-            search_stats& stats) {
-    // If assignment is complete, just check if it satisfies contraints.
-    if (is_assignment_complete(D)) {
-        if (satisfies(C, D))
-            return true;
-        else
+// The set of the levels of all the decisions taken.
+static void all_levels(const search_state& S, array<uint64_t>& levels) {
+    fill(levels, uint64_t(0));
+    for (int l = 1; l <= S.levels.count; ++l) levels[l / 64] |= bit(l);
+}
+
+// Record a solution of branch and bound, which costs less than the bound.
+static void improve_solution(search_state& S) {
+    auto&     O    = *S.objective;
+    auto&     D    = S.domains;
+    long long cost = 0;
+    for (int i = 0; i < O.variables.count; ++i) {
+        auto& d = D[O.variables[i]];
+        cost += O.costs[i][d.value() - d.offset];
+    }
+    S.bound      = cost;
+    S.best.count = D.count;
+    for (int v = 0; v < D.count; ++v) S.best[v] = {v, D[v].value()};
+
+    auto& options = *S.optimize;
+    if (not options.on_solution) return;
+    if (options.maximize) cost = -cost;
+    if (not options.on_solution(S.best, cost, options.data)) S.stopped = true;
+}
+
+bool propagate_objective(search_state& S) {
+    if (S.bound == LLONG_MAX) return true;
+    stack_frame_on(*S.stack);
+    auto& O = *S.objective;
+    auto& D = S.domains;
+
+    // Sum of the smallest cost of each variable.
+    auto      min_costs = allocate<int>(O.variables.count, *S.stack);
+    long long lower     = 0;
+    for (int i = 0; i < O.variables.count; ++i) {
+        auto& d      = D[O.variables[i]];
+        min_costs[i] = INT_MAX;
+        for (int v : d) {
+            int cost = O.costs[i][v - d.offset];
+            if (cost < min_costs[i]) min_costs[i] = cost;
+        }
+        lower += min_costs[i];
+    }
+
+    // Every removal and the failure depend on all the domains.
+    bool learning = S.conflict.count > 0;
+    if (lower >= S.bound) {
+        if (learning) all_levels(S, S.conflict);
+        return false;
+    }
+
+    // The values that cost more than the slack reach the bound. Unless a
+    // variable appears twice, the smallest costs stay the same.
+    for (int i = 0; i < O.variables.count; ++i) {
+        int   x     = O.variables[i];
+        auto& d     = D[x];
+        auto  slack = S.bound - 1 - (lower - min_costs[i]);
+        auto  mask  = make_empty_like(d, *S.stack);
+        for (int v : d)
+            if (O.costs[i][v - d.offset] <= slack) insert(mask, v);
+        S.reason = trail_entry::OBJECTIVE;
+        restrict_domain(S, x, mask);
+        S.reason = trail_entry::DECISION;
+        if (is_empty(d)) {
+            if (learning) all_levels(S, S.conflict);
+            clear_schedule(S);
             return false;
+        }
     }
+    return true;
+}
 
-    int variable = choose_variable(D, C);
+bool search(search_state& S, int depth, search_stats& stats) {
+    stack_frame_on(*S.stack);
+    auto& D = S.domains;
 
-    auto values = copy(D[variable]);
-    shuffle(values);
+    // If assignment is complete, just check if it satisfies contraints.
+    // Fixed variables are not in the heap of the variable heuristic.
+    bool learning = S.conflict.count > 0;
+    visit_node(S, depth);
+    if (S.heap.count == 0) {
+        bool success = check_leaf(S);
+        if (success) trace(S, trace_event::SOLUTION);
+        if (success and not S.objective) return true;
+        // Branch and bound goes on looking for better solutions.
+        if (success) improve_solution(S);
+        // Not explained by a propagator, so every decision is blamed.
+        if (learning) all_levels(S, S.conflict);
+        return false;
+    }
+
+    int variable = choose_variable(S);
+    int level    = S.levels.count + 1;
+
+    // With learning, the levels this node failed because of: the ones of the
+    // failures of the values tried, except this level, then the reasons of
+    // the values already removed from the variable. None of them is deeper.
+    auto conflict = array<uint64_t>{};
+    if (learning)
+        conflict = allocate<uint64_t>(num_words(level), uint64_t(0), *S.stack);
+
+    auto values = domain_values(D[variable], *S.stack);
+    if (S.options.value_heuristic == search_options::RANDOM_VALUES)
+        shuffle(values, S.random);
+    if (S.phases.count > 0) {
+        for (int i = 0; i < values.count; ++i) {
+            if (values[i] != S.phases[variable]) continue;
+            values[i] = values[0];
+            values[0] = S.phases[variable];
+            break;
+        }
+    }
     for (int val : values) {
-        stack_frame();
+        // Another search or the caller asked to stop, see solve_portfolio().
+        if (S.stop and S.stop->load(std::memory_order_relaxed))
+            S.stopped = true;
+        if (S.stopped) return false;
+        if (stats.backtracks >= S.restart_at) {
+            S.restarting = true;
+            return false;
+        }
         stats.expansions += 1;
 
-        // Copying the domains to make a temp version.
-        auto D_attempt      = copy(D);
-        D_attempt[variable] = {val};
+        // Save point, every change to the domains from here on is trailed.
+        save_level(S);
+        assign_value(S, variable, val);
+        trace(S, trace_event::DECISION, variable, val);
+        if (learning) add_decision(S, variable, val);
+        if (S.phases.count > 0) S.phases[variable] = val;
 
-        // Check if assignment satisfies constraints.
-        if (not satisfies(C, D_attempt)) continue;
+        // Propagate assignment and eventually reduce domains, then make the
+        // recursive call. Constraints are checked by their propagators.
+        bool propagated = do_inferences(S);
+        trace(S, trace_event::PROPAGATION, propagated,
+              S.trail.count - S.levels.back());
+        bool success = propagated and search(S, depth + 1, stats);
+        if (success) return true;
 
-        // Propagate assignment and eventually reduce domains.
-        if (not do_inferences(C, D_attempt)) continue;
+        // Undo the changes made by this attempt.
+        restore_level(S);
+        if (S.restarting or S.stopped) return false;
+        if (not learning) continue;
 
-        // Recursive call.
-        bool success = search(C, D_attempt, depth + 1, stats);
-        if (success) {
-            copy_to(D_attempt, D);  // update the domains.
-            return true;
-        }
+        // The failure does not depend on this decision, the other values
+        // would fail the same way. Jump back to the last decision it does
+        // depend on.
+        if ((S.conflict[level / 64] & bit(level)) == 0) return false;
+
+        // Failures found by propagation alone would be found again anyway.
+        if (propagated) learn_nogood(S, S.conflict);
+        S.conflict[level / 64] &= ~bit(level);
+        for (int k = 0; k < conflict.count; ++k) conflict[k] |= S.conflict[k];
     }
 
     // Return failure. Backtrack.
+    if (learning) {
+        set_conflict(S, {&variable, 1});
+        for (int k = 0; k < conflict.count; ++k) S.conflict[k] |= conflict[k];
+    }
     stats.backtracks += 1;
+    trace(S, trace_event::BACKTRACK);
     return false;
 }
 
+bool search_with_restarts(search_state& S, search_stats& stats) {
+    auto& options = S.options;
+    auto  limit   = (double)options.restart_base;
+    for (int run = 0;; ++run) {
+        // Limit on the backtracks of this run.
+        S.restarting = false;
+        S.restart_at = LLONG_MAX;
+        if (options.restarts == search_options::LUBY_RESTARTS)
+            limit = (double)options.restart_base * luby(run);
+        if (options.restarts != search_options::NO_RESTARTS and
+            stats.backtracks + limit < (double)LLONG_MAX)
+            S.restart_at = stats.backtracks + (long long)limit;
+        if (options.restarts == search_options::GEOMETRIC_RESTARTS)
+            limit *= options.restart_factor;
+
+        if (search(S, 0, stats)) return true;
+        if (not S.restarting) return false;
+        stats.restarts += 1;
+        trace(S, trace_event::RESTART, run + 1);
+        if (not options.keep_weights) reset_weights(S);
+    }
+}
+
 Assignment search(const CSP& csp, const Assignment& assignment,
-                  search_stats& stats) {
-    stack_frame();
-    auto D = copy(csp.domains);
+                  search_stats& stats, const search_options& options,
+                  stack_allocator& stack) {
+    // The solution is allocated before the frame of the search, to outlive
+    // it, and filled when the search is over.
+    reserve_profile(stats, csp, stack);
+    auto solution = allocate<struct assignment>(csp.domains.count, stack);
+    stack_frame_on(stack);
+    auto  S      = make_search_state(csp, options, stack);
+    auto& D      = S.domains;
+    auto  result = [&]() {
+        copy_to(make_assignment(D, stack), solution);
+        finish_state(stats, S);
+        return solution;
+    };
 
-    apply_assignment(D, assignment);
-    constraints_propagation(csp.constraints, D);
+    for (auto& a : assignment) assign_value(S, a.variable, a.value);
+    schedule_all(S);
+    if (not constraints_propagation(S)) {
+        printf("No solution found! (propagation failed)\n");
+        return result();
+    }
 
     if (is_assignment_complete(D)) {
-        if (not satisfies(csp.constraints, D)) {
+        if (not satisfies(csp.constraints, D, stack)) {
             printf("No solution found! (search not needed)\n");
             print_unsatisfied(D, csp.constraints);
         }
-        return make_assignment(D);
+        return result();
     }
 
-    bool success  = search(csp.constraints, D, 0, stats);
-    auto solution = make_assignment(D);
+    bool success = search_with_restarts(S, stats);
+    result();
     if (success) {
-        bool check = satisfies(csp.constraints, D);
+        bool check = satisfies(csp.constraints, D, stack);
         if (not check) {
             printf("\n***** Search found a solution, but it's wrong! *****\n");
             print_unsatisfied(D, csp.constraints);
@@ -103,117 +348,906 @@ Assignment search(const CSP& csp, const Assignment& assignment,
     }
 }
 
-int choose_variable(const array<Domain>& D, const array<Constraint>& C) {
-    // Choose following minimun remaining values heuristic.
-    // Gradually update min_size and populate candidates with all
-    // the variables that have domain size == min_size.
-    stack_frame();
-    auto candidates  = allocate<int>(D.size());
-    candidates.count = 0;
-    int min_size     = 9999999;  // @Hack.
-    for (int i = 0; i < D.size(); i++) {
-        auto size = D[i].size();
-        if (size == 1) continue;
-        if (size == min_size) candidates.push_back(i);
-        if (size < min_size) {
-            min_size   = size;
-            candidates = {i};
+// Same as search(), but visiting every solution until the limit or the
+// callback stop it. Returns false to stop.
+static bool enumerate_subtree(search_state& S, int depth,
+                              const enumerate_options& E, long long& count,
+                              search_stats& stats) {
+    stack_frame_on(*S.stack);
+    auto& D = S.domains;
+    visit_node(S, depth);
+    if (S.heap.count == 0) {
+        if (E.check_solutions and not check_leaf(S)) return true;
+        trace(S, trace_event::SOLUTION);
+        count += 1;
+        if (E.on_solution and not E.on_solution(D, E.data)) return false;
+        return E.max_solutions < 0 or count < E.max_solutions;
+    }
+
+    int  variable = choose_variable(S);
+    auto values   = domain_values(D[variable], *S.stack);
+    if (S.options.value_heuristic == search_options::RANDOM_VALUES)
+        shuffle(values, S.random);
+    for (int val : values) {
+        stats.expansions += 1;
+        save_level(S);
+        assign_value(S, variable, val);
+        trace(S, trace_event::DECISION, variable, val);
+        bool propagated = do_inferences(S);
+        trace(S, trace_event::PROPAGATION, propagated,
+              S.trail.count - S.levels.back());
+        bool more = not propagated or
+                    enumerate_subtree(S, depth + 1, E, count, stats);
+        restore_level(S);
+        if (not more) return false;
+    }
+    stats.backtracks += 1;
+    trace(S, trace_event::BACKTRACK);
+    return true;
+}
+
+long long enumerate_solutions(const CSP& csp, const enumerate_options& options,
+                              search_stats& stats, stack_allocator& stack) {
+    reserve_profile(stats, csp, stack);
+    stack_frame_on(stack);
+    // Backjumping would skip solutions, and restarts would repeat them.
+    auto search          = options.search;
+    search.learn_nogoods = false;
+    search.restarts      = search_options::NO_RESTARTS;
+    auto S               = make_search_state(csp, search, stack);
+
+    long long count = 0;
+    if (options.max_solutions == 0) return count;
+    schedule_all(S);
+    if (constraints_propagation(S))
+        enumerate_subtree(S, 0, options, count, stats);
+    finish_state(stats, S);
+    return count;
+}
+
+Assignment optimize(const CSP& csp, const Objective& objective,
+                    const optimize_options& options, search_stats& stats,
+                    long long* cost, stack_allocator& stack) {
+    // The best solution is allocated before the frame of the search, to
+    // outlive it.
+    reserve_profile(stats, csp, stack);
+    auto best  = allocate<struct assignment>(csp.domains.count, stack);
+    best.count = 0;
+    stack_frame_on(stack);
+
+    // Maximizing is minimizing the opposite costs.
+    auto minimized = objective;
+    if (options.maximize) {
+        minimized.costs = copy(objective.costs, stack);
+        for (auto& costs : minimized.costs)
+            for (auto& c : costs) c = -c;
+    }
+
+    auto S      = make_search_state(csp, options.search, stack);
+    S.objective = &minimized;
+    S.optimize  = &options;
+    S.best      = best;
+    S.stop      = options.stop;
+    schedule_all(S);
+    if (constraints_propagation(S)) search_with_restarts(S, stats);
+    finish_state(stats, S);
+
+    if (cost and S.best.count > 0)
+        *cost = options.maximize ? -S.bound : S.bound;
+    best.count = S.best.count;
+    return best;
+}
+
+// Threads to run for a number asked by the caller, at least one.
+static int worker_count(int num_threads) {
+    return num_threads < 1 ? 1 : num_threads;
+}
+
+// Allocator of a worker thread on its arena. It is also the default one of
+// the thread, for the callbacks that allocate without being given a stack.
+static stack_allocator& worker_allocator(memory_arena& arena) {
+    auto& stack = default_allocator();
+    stack       = stack_allocator{&arena, 0};
+    return stack;
+}
+
+Assignment solve_portfolio(const CSP&                    csp,
+                           const array<search_options>& workers,
+                           search_stats& stats, size_t arena_size,
+                           stack_allocator& stack) {
+    // Written only by the first worker that finds a solution.
+    assert(workers.count > 0 and "a portfolio needs a worker");
+    reserve_profile(stats, csp, stack);
+    auto solution = allocate<struct assignment>(csp.domains.count, stack);
+    stack_frame_on(stack);
+    auto worker_stats = allocate<search_stats>(workers.count, stack);
+    fill(worker_stats, search_stats{});
+    for (auto& s : worker_stats) reserve_profile(s, csp, stack);
+
+    auto stop   = std::atomic<bool>(false);
+    auto winner = std::atomic<int>(-1);
+    auto work   = [&](int i) {
+        auto  arena        = memory_arena(arena_size);
+        auto& worker_stack = worker_allocator(arena);
+        auto  S            = make_search_state(csp, workers[i], worker_stack);
+        S.stop             = &stop;
+
+        schedule_all(S);
+        bool found = constraints_propagation(S) and
+                     search_with_restarts(S, worker_stats[i]);
+        finish_state(worker_stats[i], S);
+        if (not found) return;
+
+        int none = -1;
+        if (not winner.compare_exchange_strong(none, i)) return;
+        copy_to(make_assignment(S.domains, worker_stack), solution);
+        stop = true;
+    };
+
+    auto threads = std::vector<std::thread>();
+    for (int i = 0; i < workers.count; ++i) threads.emplace_back(work, i);
+    for (auto& thread : threads) thread.join();
+    if (winner == -1) solution.count = 0;
+
+    for (auto& s : worker_stats) add_stats(stats, s);
+    return solution;
+}
+
+Assignment solve_portfolio(const CSP& csp, int num_threads,
+                           search_stats&         stats,
+                           const search_options& options, size_t arena_size,
+                           stack_allocator& stack) {
+    // The solution is allocated before the workers, to outlive them.
+    auto solution = allocate<struct assignment>(csp.domains.count, stack);
+    stack_frame_on(stack);
+    int  n       = worker_count(num_threads);
+    auto workers = allocate<search_options>(n, options, stack);
+    for (int i = 0; i < n; ++i) workers[i].seed = options.seed + i;
+    copy_to(solve_portfolio(csp, workers, stats, arena_size, stack), solution);
+    return solution;
+}
+
+// A subproblem of parallel_search(): the decisions from the root.
+struct search_task {
+    std::vector<assignment> decisions;
+};
+
+struct task_queue {
+    std::mutex              mutex;
+    std::deque<search_task> tasks;
+};
+
+// Shared by the workers of parallel_search().
+struct search_pool {
+    const parallel_options& options;
+    std::vector<task_queue> queues;
+    std::atomic<long long>  pending = {0};  // queued or running tasks
+    std::atomic<long long>  queued  = {0};
+    std::atomic<int>        idle    = {0};  // workers looking for tasks
+    std::atomic<bool>       stop    = {false};
+    std::atomic<int>        winner  = {-1};
+    std::atomic<long long>  num_solutions = {0};
+    std::mutex              solution_mutex;
+    Assignment              solution;
+
+    // Idle workers sleep on wake until a task is queued, the tasks are all
+    // done or the search stops.
+    std::mutex              wake_mutex;
+    std::condition_variable wake;
+
+    search_pool(const parallel_options& o, int n) : options(o), queues(n) {}
+};
+
+// Decision taken at a depth of a worker's search, and the values left to try.
+struct search_frame {
+    int        variable;
+    int        value;
+    array<int> values;
+    int        next;
+};
+
+struct search_worker {
+    int                     id;
+    search_pool*            pool;
+    search_state            S;
+    search_stats            stats;
+    std::vector<assignment> decisions;  // of the current task
+    array<search_frame>     frames;
+};
+
+// Wake the idle workers after the condition they wait for changed. Taking
+// the mutex orders the change before their check or their sleep.
+static void wake_workers(search_pool& pool, bool all) {
+    { std::lock_guard<std::mutex> lock(pool.wake_mutex); }
+    if (all)
+        pool.wake.notify_all();
+    else
+        pool.wake.notify_one();
+}
+
+static void push_task(search_worker& W, search_task&& task) {
+    auto& queue = W.pool->queues[W.id];
+    W.pool->pending += 1;
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back(std::move(task));
+        W.pool->queued += 1;
+    }
+    wake_workers(*W.pool, false);
+}
+
+// Take a task from the back of the own queue, or steal one from the front of
+// the queue of another worker.
+static bool pop_task(search_worker& W, search_task& task) {
+    auto& queues = W.pool->queues;
+    int   n      = (int)queues.size();
+    int   victim = random_int(W.S.random, n);
+    for (int k = 0; k < n; ++k) {
+        int   i     = k == 0 ? W.id : (victim + k) % n;
+        auto& queue = queues[i];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty()) continue;
+        W.pool->queued -= 1;
+        if (i == W.id) {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+        } else {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+        }
+        return true;
+    }
+    return false;
+}
+
+// Give away the values left at the shallowest depth with some, which lead to
+// the largest subtrees.
+static void donate(search_worker& W, int depth) {
+    for (int d = 0; d <= depth; ++d) {
+        auto& frame = W.frames[d];
+        if (frame.next == frame.values.count) continue;
+        for (int i = frame.next; i < frame.values.count; ++i) {
+            auto task = search_task{W.decisions};
+            for (int k = 0; k < d; ++k) {
+                auto& f = W.frames[k];
+                task.decisions.push_back({f.variable, f.value});
+            }
+            task.decisions.push_back({frame.variable, frame.values[i]});
+            push_task(W, std::move(task));
+        }
+        frame.values.count = frame.next;
+        return;
+    }
+}
+
+static void found_solution(search_worker& W) {
+    auto& pool = *W.pool;
+    auto  mode = pool.options.mode;
+    if (mode == parallel_options::FIRST_SOLUTION) {
+        int none = -1;
+        if (not pool.winner.compare_exchange_strong(none, W.id)) return;
+        copy_to(make_assignment(W.S.domains, *W.S.stack), pool.solution);
+        pool.num_solutions += 1;
+        pool.stop = true;
+        wake_workers(pool, true);
+        return;
+    }
+    pool.num_solutions += 1;
+    if (mode == parallel_options::ALL_SOLUTIONS and pool.options.on_solution) {
+        stack_frame_on(*W.S.stack);
+        auto solution = make_assignment(W.S.domains, *W.S.stack);
+        std::lock_guard<std::mutex> lock(pool.solution_mutex);
+        pool.options.on_solution(solution, pool.options.data);
+    }
+}
+
+// Same as search(), but visiting the whole subtree unless asked to stop, and
+// with the values left at each depth in the frames, to be donated.
+static void search_subtree(search_worker& W, int depth) {
+    auto& S = W.S;
+    stack_frame_on(*S.stack);
+    visit_node(S, (int)W.decisions.size() + depth);
+    if (S.heap.count == 0) {
+        if (not check_leaf(S)) return;
+        trace(S, trace_event::SOLUTION);
+        found_solution(W);
+        return;
+    }
+
+    auto& frame    = W.frames[depth];
+    frame.variable = choose_variable(S);
+    frame.values   = domain_values(S.domains[frame.variable], *S.stack);
+    frame.next     = 0;
+    if (S.options.value_heuristic == search_options::RANDOM_VALUES)
+        shuffle(frame.values, S.random);
+
+    auto& pool = *W.pool;
+    while (frame.next < frame.values.count) {
+        if (pool.stop.load(std::memory_order_relaxed)) return;
+        frame.value = frame.values[frame.next++];
+        W.stats.expansions += 1;
+
+        // Split the tree only when some worker is waiting for a task.
+        if (pool.idle.load(std::memory_order_relaxed) > 0 and
+            pool.queued.load(std::memory_order_relaxed) == 0)
+            donate(W, depth);
+
+        save_level(S);
+        assign_value(S, frame.variable, frame.value);
+        trace(S, trace_event::DECISION, frame.variable, frame.value);
+        bool propagated = constraints_propagation(S);
+        trace(S, trace_event::PROPAGATION, propagated,
+              S.trail.count - S.levels.back());
+        if (propagated) search_subtree(W, depth + 1);
+        restore_level(S);
+    }
+    W.stats.backtracks += 1;
+    trace(S, trace_event::BACKTRACK);
+}
+
+static void run_worker(search_worker& W) {
+    auto& pool = *W.pool;
+    auto& S    = W.S;
+
+    // Propagate the root once, every task starts from there.
+    schedule_all(S);
+    bool root_ok = constraints_propagation(S);
+    auto task    = search_task{};
+    while (true) {
+        if (not pop_task(W, task)) {
+            pool.idle += 1;
+            bool found = false;
+            while (not found and pool.pending > 0 and not pool.stop) {
+                {
+                    std::unique_lock<std::mutex> lock(pool.wake_mutex);
+                    pool.wake.wait(lock, [&]() {
+                        return pool.queued > 0 or pool.pending == 0 or
+                               pool.stop;
+                    });
+                }
+                found = pop_task(W, task);
+            }
+            pool.idle -= 1;
+            if (not found) return;
+        }
+
+        if (root_ok and not pool.stop) {
+            W.decisions = task.decisions;
+            save_level(S);
+            for (auto& d : task.decisions) assign_value(S, d.variable, d.value);
+            if (constraints_propagation(S)) search_subtree(W, 0);
+            restore_level(S);
+        }
+        if (--pool.pending == 0) wake_workers(pool, true);
+    }
+}
+
+long long parallel_search(const CSP& csp, const parallel_options& options,
+                          search_stats& stats, Assignment* solution,
+                          stack_allocator& stack) {
+    // The solution is allocated before the workers, to outlive them.
+    reserve_profile(stats, csp, stack);
+    int n         = worker_count(options.num_threads);
+    auto pool     = search_pool(options, n);
+    pool.solution = allocate<struct assignment>(csp.domains.count, stack);
+    stack_frame_on(stack);
+
+    auto work = [&](search_worker& W) {
+        auto  arena        = memory_arena(options.arena_size);
+        auto& worker_stack = worker_allocator(arena);
+        auto  search       = options.search;
+        search.seed += W.id;
+        // Nogoods and restarts work only along the branches of search().
+        search.learn_nogoods = false;
+        search.restarts      = search_options::NO_RESTARTS;
+        W.S      = make_search_state(csp, search, worker_stack);
+        W.frames = allocate<search_frame>(csp.domains.count, worker_stack);
+        run_worker(W);
+        finish_state(W.stats, W.S);
+    };
+
+    auto workers = std::vector<search_worker>(n);
+    for (int i = 0; i < n; ++i) workers[i].id = i;
+    for (auto& W : workers) W.pool = &pool;
+    for (auto& W : workers) reserve_profile(W.stats, csp, stack);
+    push_task(workers[0], search_task{});
+
+    auto threads = std::vector<std::thread>();
+    for (auto& W : workers) threads.emplace_back(work, std::ref(W));
+    for (auto& thread : threads) thread.join();
+
+    for (auto& W : workers) add_stats(stats, W.stats);
+    if (pool.winner == -1) pool.solution.count = 0;
+    if (solution) *solution = pool.solution;
+    return pool.num_solutions;
+}
+
+// Shared by the workers of solve_batch().
+struct batch_pool {
+    const batch_options&    options;
+    int                     num_threads;
+    std::atomic<long long>  next      = {0};  // next instance to take
+    std::atomic<long long>  end       = {LLONG_MAX};  // first that is missing
+    std::atomic<long long>  delivered = {0};  // in order, with ordered
+    std::mutex              mutex;
+    std::condition_variable progress;  // signalled when delivered or end move
+
+    // Solutions of the instances after delivered, waiting for their turn.
+    std::map<long long, std::vector<assignment>> pending;
+
+    batch_pool(const batch_options& o, int n) : options(o), num_threads(n) {}
+};
+
+// Bring a state back to the root of the model, as it was made, with the
+// random values of an instance.
+static void reset_state(search_state& S, uint64_t seed) {
+    restore_trail(S, 0);
+    S.levels.count = 0;
+    clear_schedule(S);
+    S.random = make_rng(seed);
+    reset_weights(S);
+    fill(S.phases, INT_MIN);
+    if (S.conflict.count > 0) {
+        auto& N       = S.nogoods;
+        N.sizes.count = 0;
+        N.increment   = 1;
+        N.checked     = 0;
+        fill(N.first_watch, -1);
+    }
+}
+
+// Search an instance from the root of the state.
+static bool solve_instance(search_state& S, const array<Domain>& domains,
+                           search_stats& stats) {
+    for (int v = 0; v < domains.count; ++v) {
+        restrict_domain(S, v, domains[v]);
+        if (is_empty(S.domains[v])) return false;
+    }
+    schedule_all(S);
+    if (not constraints_propagation(S)) return false;
+    return search_with_restarts(S, stats);
+}
+
+static void deliver(batch_pool& pool, long long i, const Assignment& solution) {
+    auto& options = pool.options;
+    if (not options.on_solution) return;
+    std::lock_guard<std::mutex> lock(pool.mutex);
+    if (not options.ordered) {
+        options.on_solution(i, solution, options.data);
+        return;
+    }
+    if (i != pool.delivered) {
+        pool.pending[i].assign(solution.data, solution.data + solution.count);
+        return;
+    }
+    options.on_solution(i, solution, options.data);
+    pool.delivered += 1;
+    for (auto it = pool.pending.begin();
+         it != pool.pending.end() and it->first == pool.delivered;) {
+        auto& waiting = it->second;
+        auto  next    = array<assignment>(waiting.data(), (int)waiting.size());
+        options.on_solution(it->first, next, options.data);
+        pool.delivered += 1;
+        it = pool.pending.erase(it);
+    }
+    pool.progress.notify_all();
+}
+
+static void run_batch_worker(batch_pool& pool, const CSP& csp,
+                             search_stats& stats) {
+    auto& options = pool.options;
+    auto  arena   = memory_arena(options.arena_size);
+    auto& stack   = worker_allocator(arena);
+    auto  S       = make_search_state(csp, options.search, stack);
+    auto  domains = copy(csp.domains, stack);
+
+    // With ordered solutions, the instances solved ahead of the next one to
+    // deliver are kept, up to a limit.
+    bool ordered = options.ordered and options.on_solution;
+    auto window  = 64 * (long long)pool.num_threads;
+    while (true) {
+        long long i = pool.next++;
+        if (ordered and i >= pool.delivered + window and i < pool.end) {
+            std::unique_lock<std::mutex> lock(pool.mutex);
+            pool.progress.wait(lock, [&]() {
+                return i < pool.delivered + window or i >= pool.end;
+            });
+        }
+        if (i >= pool.end) break;
+
+        stack_frame_on(stack);
+        copy_to(csp.domains, domains);
+        if (not options.get_instance(i, domains, options.data)) {
+            // The instance is the first missing one, unless a smaller one is.
+            long long end = pool.end;
+            while (i < end and not pool.end.compare_exchange_weak(end, i)) {}
+            std::lock_guard<std::mutex> lock(pool.mutex);
+            pool.progress.notify_all();
+            break;
+        }
+        reset_state(S, options.search.seed + i);
+        bool found    = solve_instance(S, domains, stats);
+        auto solution = found ? make_assignment(S.domains, stack)
+                              : Assignment{};
+        deliver(pool, i, solution);
+    }
+    finish_state(stats, S);
+}
+
+long long solve_batch(const CSP& csp, const batch_options& options,
+                      search_stats& stats, stack_allocator& stack) {
+    reserve_profile(stats, csp, stack);
+    stack_frame_on(stack);
+    int  n            = worker_count(options.num_threads);
+    auto pool         = batch_pool(options, n);
+    auto worker_stats = allocate<search_stats>(n, stack);
+    fill(worker_stats, search_stats{});
+    for (auto& s : worker_stats) reserve_profile(s, csp, stack);
+
+    auto threads = std::vector<std::thread>();
+    for (int i = 0; i < n; ++i)
+        threads.emplace_back(run_batch_worker, std::ref(pool), std::cref(csp),
+                             std::ref(worker_stats[i]));
+    for (auto& thread : threads) thread.join();
+
+    for (auto& s : worker_stats) add_stats(stats, s);
+    return pool.end == LLONG_MAX ? pool.next.load() : pool.end.load();
+}
+
+const char* intern_name(const char* name) {
+    static std::mutex                      mutex;
+    static std::unordered_set<std::string> names;
+    std::lock_guard<std::mutex>            lock(mutex);
+    return names.insert(name).first->c_str();
+}
+
+void finalize_csp(CSP& csp) {
+    auto& C   = csp.constraints;
+    auto& adj = csp.adjacency;
+    int   n   = csp.domains.count;
+
+    // Constraint -> variables, that is all the scopes one after the other.
+    adj.constraint_start    = allocate<int>(C.count + 1);
+    adj.constraint_start[0] = 0;
+    for (int c = 0; c < C.count; ++c) {
+        adj.constraint_start[c + 1] = adj.constraint_start[c];
+        adj.constraint_start[c + 1] += C[c].scope.count;
+    }
+    adj.constraint_variables       = allocate<int>(adj.constraint_start.back());
+    adj.constraint_variables.count = 0;
+    for (auto& c : C) adj.constraint_variables += c.scope;
+
+    // Variable -> constraints, and degrees.
+    adj.variable_start = allocate<int>(n + 1, 0);
+    adj.degrees        = allocate<int>(n, 0);
+    for (auto& c : C) {
+        for (int v : c.scope) {
+            adj.variable_start[v + 1] += 1;
+            adj.degrees[v] += c.scope.count - 1;
         }
     }
-    assert(candidates.size() > 0);
+    for (int v = 0; v < n; ++v)
+        adj.variable_start[v + 1] += adj.variable_start[v];
 
-    // If no ties, return the variable.
-    if (candidates.size() == 1) return candidates[0];
+    adj.variable_constraints = allocate<int>(adj.variable_start[n]);
 
-    // If there's a tie, use Max Degree heuristic.
-    // Start with computing degrees. We could cache that, but it
-    // is probably unexpensive to compute them on the fly (@Profile it).
-    auto degrees = allocate<int>(D.size(), 0);
-    for (auto& c : C)
-        for (int v : c.scope) degrees[v] += c.scope.size() - 1;
+    // Scopes point into the constraint -> variables index, and constants into
+    // a single array, so walking the constraints walks contiguous memory.
+    int num_constants = 0;
+    for (auto& c : C) num_constants += c.constants.count;
+    auto constants  = allocate<int>(num_constants);
+    constants.count = 0;
+    for (int c = 0; c < C.count; ++c) {
+        auto& scope = C[c].scope;
+        scope.data  = adj.constraint_variables.data + adj.constraint_start[c];
+        auto start  = constants.count;
+        constants += C[c].constants;
+        C[c].constants.data = constants.data + start;
+    }
+
+    // For each variable of a table and each value of its domain, the bitset
+    // of the tuples that support it, shared by all the searches.
+    for (auto& c : C) {
+        if (c.type != Constraint::TABLE) continue;
+        int arity      = c.scope.count;
+        int num_tuples = c.constants.count / arity;
+        int w          = num_words(num_tuples);
+        int size       = 0;
+        for (int v : c.scope) size += 64 * csp.domains[v].num_words * w;
+        c.supports    = allocate<uint64_t>(size, uint64_t(0));
+        auto supports = c.supports.data;
+        for (int i = 0; i < arity; ++i) {
+            auto& d = csp.domains[c.scope[i]];
+            for (int t = 0; t < num_tuples; ++t) {
+                int k = c.constants[t * arity + i] - d.offset;
+                if (k < 0 or k >= 64 * d.num_words) continue;
+                supports[k * w + t / 64] |= bit(t);
+            }
+            supports += 64 * d.num_words * w;
+        }
+    }
 
-    int max_degree_idx = candidates[0];
-    int max_degree     = degrees[max_degree_idx];
-    for (int i = 1; i < candidates.size(); ++i) {
-        int v = candidates[i];
-        if (degrees[v] > max_degree) {
-            max_degree_idx = v;
-            max_degree     = degrees[v];
+    stack_frame();
+    auto fill = copy(adj.variable_start);
+    for (int c = 0; c < C.count; ++c)
+        for (int v : C[c].scope) adj.variable_constraints[fill[v]++] = c;
+}
+
+int choose_variable(const search_state& S) {
+    // The heap keeps the unfixed variables ordered by the chosen heuristic
+    // (minimum remaining values and max degree by default), so the best
+    // variable is always on top.
+    assert(S.heap.count > 0);
+    return S.heap[0];
+}
+
+bool constraints_propagation(search_state& S) {
+    auto& C = S.csp->constraints;
+    while (S.queue.count > 0) {
+        int c         = next_scheduled(S);
+        S.propagating = c;
+        S.propagations += 1;
+#if CSP_PROFILE
+        // Heap updates are counted by the heuristic.
+        auto start     = read_cycles();
+        auto heuristic = S.profile.heuristic_cycles;
+#endif
+        bool ok = propagate(C[c], S);
+#if CSP_PROFILE
+        S.profile.propagations[C[c].type] += 1;
+        S.profile.propagate_cycles += read_cycles() - start;
+        S.profile.propagate_cycles -= S.profile.heuristic_cycles - heuristic;
+        if (not ok) S.profile.wipeouts[c] += 1;
+#endif
+        // Changes made outside propagators must wake every watcher.
+        S.propagating = -1;
+        if (not ok) {
+            trace(S, trace_event::WIPEOUT, c);
+            bump_weight(S, c);
+            if (S.conflict.count > 0) set_conflict(S, variables_of(*S.csp, c));
+            clear_schedule(S);
+            return false;
         }
     }
-    assert(max_degree_idx < D.size());
-    assert(D[max_degree_idx].size() > 1);
-    return max_degree_idx;
+    return true;
+}
+
+static bool holds(const search_state& S, const assignment& decision) {
+    auto& d = S.domains[decision.variable];
+    return d.size() == 1 and d.value() == decision.value;
 }
 
-bool constraints_propagation(const array<Constraint>& C, array<Domain>& D) {
-    for (auto& c : C)
-        if (not propagate(c, D)) return false;
+static void watch(nogood_database& N, int nogood, int i, int variable) {
+    N.next_watch[2 * nogood + i] = N.first_watch[variable];
+    N.first_watch[variable]      = 2 * nogood + i;
+}
+
+static void bump_activity(nogood_database& N, int nogood) {
+    N.activity[nogood] += N.increment;
+    if (N.activity[nogood] < 1e20f) return;
+    for (auto& a : N.activity) a *= 1e-20f;
+    N.increment *= 1e-20f;
+}
+
+bool propagate_nogoods(search_state& S) {
+    auto& N = S.nogoods;
+    while (N.checked < S.trail.count) {
+        int variable = S.trail[N.checked++].variable;
+        if (variable == -1 or S.domains[variable].size() != 1) continue;
+        int value = S.domains[variable].value();
+
+        int* link = &N.first_watch[variable];
+        while (*link != -1) {
+            int  w         = *link;
+            int  nogood    = w / 2;
+            int  i         = w % 2;
+            int  size      = N.sizes[nogood];
+            auto decisions = N.decisions.data + nogood * N.max_size;
+            if (decisions[i].value != value) {
+                link = &N.next_watch[w];
+                continue;
+            }
+
+            // Watch a decision that does not hold instead, if any.
+            int k = 2;
+            while (k < size and holds(S, decisions[k])) k += 1;
+            if (k < size) {
+                auto watched = decisions[i];
+                decisions[i] = decisions[k];
+                decisions[k] = watched;
+                *link        = N.next_watch[w];
+                watch(N, nogood, i, decisions[i].variable);
+                continue;
+            }
+            link = &N.next_watch[w];
 
+            // Every decision holds but the other watched one, which must not.
+            stack_frame_on(*S.stack);
+            bump_activity(N, nogood);
+            auto scope = allocate<int>(size, *S.stack);
+            for (int j = 0; j < size; ++j) scope[j] = decisions[j].variable;
+            if (size == 1 or holds(S, decisions[1 - i])) {
+                set_conflict(S, scope);
+                clear_schedule(S);
+                return false;
+            }
+            auto other   = decisions[1 - i];
+            S.reason     = trail_entry::NOGOOD - nogood;
+            bool removed = remove_value(S, other.variable, other.value);
+            S.reason     = trail_entry::DECISION;
+            if (not removed) continue;
+            if (is_empty(S.domains[other.variable])) {
+                set_conflict(S, {&other.variable, 1});
+                clear_schedule(S);
+                return false;
+            }
+        }
+    }
     return true;
 }
 
+void set_conflict(search_state& S, const array<int>& variables) {
+    fill(S.conflict, uint64_t(0));
+    if (S.levels.count == 0) return;
+    if (S.mark == INT_MAX) {
+        fill(S.marks, 0);
+        S.mark = 0;
+    }
+    int mark = ++S.mark;
+    for (int v : variables) S.marks[v] = mark;
+
+    // From the last change, the variables whose changes explain the ones of
+    // the marked variables are marked in turn: a propagator removes values
+    // because of the domains of its scope. The changes made before the first
+    // level depend on no decision.
+    auto& N     = S.nogoods;
+    int   level = S.levels.count;
+    for (int i = S.trail.count - 1; i >= S.levels[0]; --i) {
+        while (i < S.levels[level - 1]) level -= 1;
+        auto& entry = S.trail[i];
+        if (entry.variable == -1 or S.marks[entry.variable] != mark) continue;
+        if (entry.reason >= 0) {
+            for (int v : variables_of(*S.csp, entry.reason)) S.marks[v] = mark;
+        } else if (entry.reason == trail_entry::DECISION) {
+            S.conflict[level / 64] |= bit(level);
+        } else if (entry.reason == trail_entry::OBJECTIVE) {
+            for (int l = 1; l <= level; ++l) S.conflict[l / 64] |= bit(l);
+            return;
+        } else {
+            int  nogood    = trail_entry::NOGOOD - entry.reason;
+            auto decisions = N.decisions.data + nogood * N.max_size;
+            for (int k = 0; k < N.sizes[nogood]; ++k)
+                S.marks[decisions[k].variable] = mark;
+        }
+    }
+}
+
+// Forget the least active half of the nogoods, keeping their watches. The
+// ones that explain changes on the trail are kept too.
+static void reduce_nogoods(search_state& S) {
+    stack_frame_on(*S.stack);
+    auto& N     = S.nogoods;
+    int   count = N.sizes.count;
+    auto  order = allocate<int>(count, *S.stack);
+    for (int g = 0; g < count; ++g) order[g] = g;
+    sort(order, [&](int a, int b) { return N.activity[a] > N.activity[b]; });
+    auto keep = allocate<bool>(count, false, *S.stack);
+    for (int g = 0; g < count / 2; ++g) keep[order[g]] = true;
+    for (auto& entry : S.trail) {
+        int g = trail_entry::NOGOOD - entry.reason;
+        if (g >= 0) keep[g] = true;
+    }
+
+    auto moved = allocate<int>(count, -1, *S.stack);
+    fill(N.first_watch, -1);
+    N.sizes.count = 0;
+    for (int g = 0; g < count; ++g) {
+        if (not keep[g]) continue;
+        int  kept = N.sizes.count;
+        moved[g]  = kept;
+        auto from = N.decisions.data + g * N.max_size;
+        auto to   = N.decisions.data + kept * N.max_size;
+        for (int k = 0; k < N.sizes[g]; ++k) to[k] = from[k];
+        N.activity[kept] = N.activity[g];
+        N.sizes.push_back(N.sizes[g]);
+        watch(N, kept, 0, to[0].variable);
+        if (N.sizes[kept] > 1) watch(N, kept, 1, to[1].variable);
+    }
+    for (auto& entry : S.trail) {
+        int g = trail_entry::NOGOOD - entry.reason;
+        if (g >= 0) entry.reason = trail_entry::NOGOOD - moved[g];
+    }
+}
+
+void learn_nogood(search_state& S, const array<uint64_t>& conflict) {
+    auto& N    = S.nogoods;
+    int   size = 0;
+    for (auto word : conflict) size += popcount(word);
+    if (size == 0 or size > N.max_size) return;
+    if (N.sizes.count == N.activity.count) reduce_nogoods(S);
+    if (N.sizes.count == N.activity.count) return;  // all explain changes
+
+    // From the last level, whose decision no longer holds, to the first. The
+    // second one is the first to be undone from now on.
+    int  nogood    = N.sizes.count;
+    auto decisions = N.decisions.data + nogood * N.max_size;
+    int  k         = 0;
+    for (int w = conflict.count - 1; w >= 0; --w) {
+        for (auto word = conflict[w]; word != 0;) {
+            int i = 63 - count_leading_zeros(word);
+            word &= ~bit(i);
+            decisions[k++] = S.decisions[64 * w + i];
+        }
+    }
+    N.sizes.push_back(size);
+    N.activity[nogood] = 0;
+    bump_activity(N, nogood);
+    watch(N, nogood, 0, decisions[0].variable);
+    if (size > 1) watch(N, nogood, 1, decisions[1].variable);
+
+    // Recent nogoods weigh more.
+    N.increment /= 0.95f;
+}
+
 bool remove_values(int variable, const Constraint& constraint,
-                   array<Domain>& D) {
-    stack_frame();
+                   array<Domain>& D, stack_allocator& stack) {
+    stack_frame_on(stack);
     bool removed_value = false;
-    int  i             = 0;
-    auto domain_tmp    = copy(D[variable]);  // copying the domain.
-    auto ones          = allocate<int>(D.size(), 1);
+    auto values = domain_values(D[variable], stack);  // copying the domain.
 
-    while (true) {
-        stack_frame();
+    for (int value : values) {
+        stack_frame_on(stack);
         // Make a fake copy of the domain. Will set the just interesting
         // variables.
-        // array<Domain> Dfake = array<Domain>(D.size(), {-1});
+        auto Dfake = allocate<Domain>(D.size(), stack);
+        for (int k = 0; k < Dfake.count; ++k)
+            Dfake[k] = make_empty_like(D[k], stack);
 
-        auto Dfake = allocate<array<int>>(D.size());
-        for (int k = 0; k < Dfake.count; ++k) {
-            Dfake[k]       = allocate<int>(D[k].count);
-            Dfake[k].count = 0;
-        }
-
-        Dfake[variable].push_back(domain_tmp[i]);
+        insert(Dfake[variable], value);
         for (auto v : constraint.scope) {
-            Dfake[v].count = D[v].count;
             if (v != variable) copy_to(D[v], Dfake[v]);  // copying the domains.
         }
 
-        bool exists = search_single_constraint(constraint, Dfake, 0);
+        bool exists = search_single_constraint(constraint, Dfake, 0, stack);
 
         if (exists == false) {
-            domain_tmp.remove(i);
-            // removed_values.push_back(domain_tmp, i);
+            remove(D[variable], value);
             removed_value = true;
-        } else {
-            i += 1;
-        }
-
-        if (i >= domain_tmp.size()) {
-            copy_to(domain_tmp, D[variable]);
-            return removed_value;
         }
     }
+    return removed_value;
 }
 
-bool gac3(const array<Constraint>& C, array<Domain>& D_result) {
-    stack_frame();
-    auto D = copy(D_result);  // copying the domains.
+bool gac3(search_state& S) {
+    stack_frame_on(*S.stack);
+    auto& stack = *S.stack;
+    auto& C     = S.csp->constraints;
+    auto& adj   = S.csp->adjacency;
+    auto  D     = copy(S.domains, stack);  // copying the domains.
 
-    int size = 0;
-    for (auto& c : C) size += c.scope.count;
-    auto var_queue    = allocate<int>(size);
-    auto const_queue  = allocate<int>(size);
+    // Every pair (v, c) is an arc, identified by the position of v in the
+    // flattened scopes of the adjacency index.
+    int  size         = adj.constraint_variables.count;
+    auto var_queue    = allocate<int>(size, stack);
+    auto const_queue  = allocate<int>(size, stack);
+    auto arc_queue    = allocate<int>(size, stack);
+    auto in_queue     = allocate<bool>(size, false, stack);
     var_queue.count   = 0;
     const_queue.count = 0;
+    arc_queue.count   = 0;
 
     // For each constraint c, for each variable v in the scope of c,
     // add the pair (v, c) to the queue.
     for (int i = 0; i < C.size(); ++i) {
-        for (int v : C[i].scope) {
-            if (D[v].size() == 1) continue;
-            var_queue.push_back(v);
-            const_queue.push_back(i);
+        int arc = adj.constraint_start[i];
+        for (int v : variables_of(*S.csp, i)) {
+            if (D[v].size() != 1) {
+                var_queue.push_back(v);
+                const_queue.push_back(i);
+                arc_queue.push_back(arc);
+                in_queue[arc] = true;
+            }
+            arc += 1;
         }
     }
 
@@ -223,58 +1257,50 @@ bool gac3(const array<Constraint>& C, array<Domain>& D_result) {
     while (var_queue.size() > 0) {
         int v = var_queue.back();
         int c = const_queue.back();
+        in_queue[arc_queue.back()] = false;
         var_queue.count -= 1;
         const_queue.count -= 1;
+        arc_queue.count -= 1;
 
-        bool removed_value_from_domain = remove_values(v, C[c], D);
+        bool removed_value_from_domain = remove_values(v, C[c], D, stack);
         if (removed_value_from_domain) {
             // If the domain was left empty, this assignment cannot
             // be made complete. search() will read {} as failure.
-            if (D[v].size() == 0) {
+            if (is_empty(D[v])) {
                 return false;
             }
 
             // If we shrinked its domain, we add to the queue all
             // the variables that are neighbors of v through other constraints.
-            for (int i = 0; i < C.size(); ++i) {
+            for (int i : constraints_of(*S.csp, v)) {
                 if (i == c) continue;
 
-                if (not contains(C[i].scope, v)) continue;
-
-                for (int w : C[i].scope) {
-                    if (w == v) continue;
-                    if (D[w].size() == 1) continue;
-
-                    // Check if it is already in queue.
-                    bool already_in_queue = false;
-                    for (int k = 0; k < var_queue.size(); k++) {
-                        if (var_queue[k] == w and const_queue[k] == i) {
-                            already_in_queue = true;
-                            break;
-                        }
-                    }
-
-                    if (not already_in_queue) {
+                int arc = adj.constraint_start[i];
+                for (int w : variables_of(*S.csp, i)) {
+                    if (w != v and D[w].size() != 1 and not in_queue[arc]) {
                         var_queue.push_back(w);
                         const_queue.push_back(i);
+                        arc_queue.push_back(arc);
+                        in_queue[arc] = true;
                     }
+                    arc += 1;
                 }
             }
         }
     }
 
-    // Return the updated domain.
-    copy_to(D, D_result);  // copying the domains.
+    // Update the domains, trailing the changes.
+    for (int v = 0; v < D.size(); ++v) restrict_domain(S, v, D[v]);
     return true;
 }
 
 bool search_single_constraint(const Constraint& c, const array<Domain>& D_,
-                              int depth) {
+                              int depth, stack_allocator& stack) {
     // Naive search that just check if there's a possible assignment that
     // satisfy only ONE constraint. Used by remove_values().
 
-    stack_frame();
-    auto D = copy(D_);
+    stack_frame_on(stack);
+    auto D = copy(D_, stack);
 
     // If assignment is complete, return true. Only admissible assignments
     // arrive here.
@@ -287,25 +1313,546 @@ bool search_single_constraint(const Constraint& c, const array<Domain>& D_,
     }
     if (complete) return true;
 
-    // Still using MRV & Max Degree.
-    auto cc       = allocate<Constraint>(1, c);
-    int  variable = choose_variable(D, cc);
+    // Still using MRV, restricted to the scope of the constraint.
+    int variable = -1;
+    for (int v : c.scope) {
+        if (D[v].size() == 1) continue;
+        if (variable == -1 or D[v].size() < D[variable].size()) variable = v;
+    }
 
-    const auto domain = copy(D[variable]);
+    const auto domain = domain_values(D[variable], stack);
     for (int val : domain) {
-        D[variable] = {val};
+        fix(D[variable], val);
 
         // If new assignment does not satisfies constraints, continue.
-        if (not eval(c, D)) continue;
+        if (not eval(c, D, stack)) continue;
 
         // @Speed: We should propagate also in search_single_constraint, but
         // copying D seems to slow down. array<Domain> D_new = D; if(not
         // c->propagate(D_new)) continue;
 
-        if (search_single_constraint(c, D, depth + 1)) {
+        if (search_single_constraint(c, D, depth + 1, stack)) {
             return true;
         }
     }
 
     return false;
 }
+
+// Maximum matching between the variables in the scope of an all_different
+// constraint and their values, see search_state::matchings.
+struct alldiff_matching {
+    const array<int>&    scope;
+    const array<Domain>& D;
+    int                  lo;           // smallest value
+    int                  m;            // number of values
+    int*                 var_match;    // value matched to each variable
+    int*                 value_match;  // variable matched to each value
+    array<int>           seen;         // last visit of each value
+    int                  stamp;
+};
+
+void match(alldiff_matching& M, int i, int value) {
+    M.var_match[i]              = value;
+    M.value_match[value - M.lo] = i;
+}
+
+// Look for an augmenting path starting from the i-th variable of the scope.
+bool augment(alldiff_matching& M, int i) {
+    auto& d = M.D[M.scope[i]];
+
+    // Take a free value if there is one.
+    for (int v : d) {
+        if (M.value_match[v - M.lo] == -1) {
+            match(M, i, v);
+            return true;
+        }
+    }
+
+    // Otherwise try to match to another value the variable matched to v.
+    for (int v : d) {
+        int k = v - M.lo;
+        if (M.seen[k] == M.stamp) continue;
+        M.seen[k] = M.stamp;
+        if (augment(M, M.value_match[k])) {
+            match(M, i, v);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool propagate_all_different_matching(const Constraint& constraint,
+                                      search_state&     S) {
+    stack_frame_on(*S.stack);
+    auto& D     = S.domains;
+    auto& scope = constraint.scope;
+    int*  data  = S.matchings.data + S.matching_start[S.propagating];
+    int   n     = scope.count;
+
+    auto M = alldiff_matching{scope,
+                              D,
+                              data[0],
+                              data[1],
+                              data + 2,
+                              data + 2 + n,
+                              allocate<int>(data[1], 0, *S.stack),
+                              0};
+
+    // Repair the matching: drop the values that were removed, then look for
+    // an augmenting path for every unmatched variable.
+    for (int i = 0; i < n; ++i) {
+        int v = M.var_match[i];
+        if (v == NO_SUPPORT or D[scope[i]].contains(v)) continue;
+        M.value_match[v - M.lo] = -1;
+        M.var_match[i]          = NO_SUPPORT;
+    }
+    for (int i = 0; i < n; ++i) {
+        if (M.var_match[i] != NO_SUPPORT) continue;
+        M.stamp += 1;
+        if (not augment(M, i)) return false;
+    }
+
+    // Directed graph with the variables as vertices [0, n) and the values as
+    // vertices [n, n + m). Edges of the matching go from variable to value,
+    // the other ones from value to variable. The edges from values are
+    // stored in compressed form.
+    int  N           = n + M.m;
+    auto value_start = allocate<int>(M.m + 1, 0, *S.stack);
+    for (int i = 0; i < n; ++i)
+        for (int v : D[scope[i]])
+            if (v != M.var_match[i]) value_start[v - M.lo + 1] += 1;
+    for (int k = 0; k < M.m; ++k) value_start[k + 1] += value_start[k];
+    auto value_vars = allocate<int>(value_start[M.m], *S.stack);
+    auto fill       = copy(value_start, *S.stack);
+    for (int i = 0; i < n; ++i)
+        for (int v : D[scope[i]])
+            if (v != M.var_match[i]) value_vars[fill[v - M.lo]++] = i;
+
+    auto num_edges = [&](int u) {
+        if (u < n) return 1;
+        return value_start[u - n + 1] - value_start[u - n];
+    };
+    auto edge = [&](int u, int e) {
+        if (u < n) return n + M.var_match[u] - M.lo;
+        return value_vars[value_start[u - n] + e];
+    };
+
+    // Strongly connected components (iterative Tarjan). Edges inside a
+    // component belong to an alternating cycle.
+    auto index     = allocate<int>(N, -1, *S.stack);
+    auto low       = allocate<int>(N, *S.stack);
+    auto component = allocate<int>(N, *S.stack);
+    auto next_edge = allocate<int>(N, 0, *S.stack);
+    auto on_stack  = allocate<bool>(N, false, *S.stack);
+    auto stack     = allocate<int>(N, *S.stack);
+    auto calls     = allocate<int>(N, *S.stack);
+    stack.count    = 0;
+    calls.count    = 0;
+    int counter    = 0;
+
+    for (int s = 0; s < N; ++s) {
+        if (index[s] != -1) continue;
+        index[s] = low[s] = counter++;
+        stack.push_back(s);
+        on_stack[s] = true;
+        calls.push_back(s);
+
+        while (calls.count > 0) {
+            int u = calls.back();
+            if (next_edge[u] < num_edges(u)) {
+                int w = edge(u, next_edge[u]);
+                next_edge[u] += 1;
+                if (index[w] == -1) {
+                    index[w] = low[w] = counter++;
+                    stack.push_back(w);
+                    on_stack[w] = true;
+                    calls.push_back(w);
+                } else if (on_stack[w] and index[w] < low[u]) {
+                    low[u] = index[w];
+                }
+                continue;
+            }
+
+            calls.count -= 1;
+            if (calls.count > 0 and low[u] < low[calls.back()])
+                low[calls.back()] = low[u];
+            if (low[u] == index[u]) {
+                int w;
+                do {
+                    w = stack.back();
+                    stack.count -= 1;
+                    on_stack[w]  = false;
+                    component[w] = u;
+                } while (w != u);
+            }
+        }
+    }
+
+    // Vertices reachable from a free value. Edges reaching them belong to an
+    // even alternating path that starts from a free value.
+    auto reached = allocate<bool>(N, false, *S.stack);
+    auto queue   = allocate<int>(N, *S.stack);
+    queue.count  = 0;
+    for (int k = 0; k < M.m; ++k) {
+        if (M.value_match[k] != -1) continue;
+        reached[n + k] = true;
+        queue.push_back(n + k);
+    }
+    for (int head = 0; head < queue.count; ++head) {
+        int u = queue[head];
+        for (int e = 0; e < num_edges(u); ++e) {
+            int w = edge(u, e);
+            if (reached[w]) continue;
+            reached[w] = true;
+            queue.push_back(w);
+        }
+    }
+
+    // Remove the values that belong to no maximum matching.
+    for (int i = 0; i < n; ++i) {
+        for (int v : D[scope[i]]) {
+            int k = n + v - M.lo;
+            if (v == M.var_match[i]) continue;
+            if (component[i] == component[k] or reached[k]) continue;
+            remove_value(S, scope[i], v);
+        }
+    }
+    return true;
+}
+
+// Bounds consistency for all_different, following "A fast and simple
+// algorithm for bounds consistency of the alldifferent constraint" by
+// Lopez-Ortiz, Quimper, Tromp and van Beek (2003). Intervals are ranked by
+// their bounds, and Hall intervals are found with union-find-like trees over
+// the ranks.
+struct bounds_interval {
+    int min, max;  // inclusive
+    int minrank, maxrank;
+};
+
+int path_max(const array<int>& t, int i) {
+    while (i < t[i]) i = t[i];
+    return i;
+}
+
+int path_min(const array<int>& t, int i) {
+    while (t[i] < i) i = t[i];
+    return i;
+}
+
+void path_set(array<int>& t, int start, int end, int to) {
+    int next = start;
+    while (next != end) {
+        int k = next;
+        next  = t[k];
+        t[k]  = to;
+    }
+}
+
+bool propagate_all_different_bounds(const Constraint& constraint,
+                                    search_state&     S) {
+    stack_frame_on(*S.stack);
+    auto& stack = *S.stack;
+    auto& scope = constraint.scope;
+    int   n     = scope.count;
+
+    auto intervals = allocate<bounds_interval>(n, stack);
+    auto minsorted = allocate<int>(n, stack);
+    auto maxsorted = allocate<int>(n, stack);
+    for (int i = 0; i < n; ++i) {
+        intervals[i].min = S.domains[scope[i]].min();
+        intervals[i].max = S.domains[scope[i]].max();
+        minsorted[i]     = i;
+        maxsorted[i]     = i;
+    }
+    sort(minsorted, [&](int a, int b) {
+        return intervals[a].min < intervals[b].min;
+    });
+    sort(maxsorted, [&](int a, int b) {
+        return intervals[a].max < intervals[b].max;
+    });
+
+    // Merge the sorted bounds (min and max + 1) into the array of ranks.
+    auto bounds = allocate<int>(2 * n + 2, stack);
+    int  nb     = 0;
+    int  min    = intervals[minsorted[0]].min;
+    int  max    = intervals[maxsorted[0]].max + 1;
+    int  last   = min - 2;
+    bounds[0]   = last;
+    for (int i = 0, j = 0;;) {
+        if (i < n and min <= max) {
+            if (min != last) bounds[++nb] = last = min;
+            intervals[minsorted[i]].minrank = nb;
+            if (++i < n) min = intervals[minsorted[i]].min;
+        } else {
+            if (max != last) bounds[++nb] = last = max;
+            intervals[maxsorted[j]].maxrank = nb;
+            if (++j == n) break;
+            max = intervals[maxsorted[j]].max + 1;
+        }
+    }
+    bounds[nb + 1] = bounds[nb] + 2;
+
+    // Tree links, differences between critical capacities and Hall interval
+    // links.
+    auto t = allocate<int>(2 * n + 2, stack);
+    auto d = allocate<int>(2 * n + 2, stack);
+    auto h = allocate<int>(2 * n + 2, stack);
+
+    // Update the lower bounds, visiting intervals by increasing max.
+    for (int i = 1; i <= nb + 1; ++i) {
+        t[i] = h[i] = i - 1;
+        d[i]        = bounds[i] - bounds[i - 1];
+    }
+    for (int i = 0; i < n; ++i) {
+        auto& interval = intervals[maxsorted[i]];
+        int   x        = interval.minrank;
+        int   y        = interval.maxrank;
+        int   z        = path_max(t, x + 1);
+        int   j        = t[z];
+        if (--d[z] == 0) {
+            t[z] = z + 1;
+            z    = path_max(t, t[z]);
+            t[z] = j;
+        }
+        path_set(t, x + 1, z, z);
+        if (d[z] < bounds[z] - bounds[y]) return false;
+        if (h[x] > x) {
+            int w        = path_max(h, h[x]);
+            interval.min = bounds[w];
+            path_set(h, x, w, w);
+        }
+        if (d[z] == bounds[z] - bounds[y]) {
+            path_set(h, h[y], j - 1, y);
+            h[y] = j - 1;
+        }
+    }
+
+    // Update the upper bounds, visiting intervals by decreasing min.
+    for (int i = 0; i <= nb; ++i) {
+        t[i] = h[i] = i + 1;
+        d[i]        = bounds[i + 1] - bounds[i];
+    }
+    for (int i = n - 1; i >= 0; --i) {
+        auto& interval = intervals[minsorted[i]];
+        int   x        = interval.maxrank;
+        int   y        = interval.minrank;
+        int   z        = path_min(t, x - 1);
+        int   j        = t[z];
+        if (--d[z] == 0) {
+            t[z] = z - 1;
+            z    = path_min(t, t[z]);
+            t[z] = j;
+        }
+        path_set(t, x - 1, z, z);
+        if (d[z] < bounds[y] - bounds[z]) return false;
+        if (h[x] < x) {
+            int w        = path_min(h, h[x]);
+            interval.max = bounds[w] - 1;
+            path_set(h, x, w, w);
+        }
+        if (d[z] == bounds[y] - bounds[z]) {
+            path_set(h, h[y], j + 1, y);
+            h[y] = j + 1;
+        }
+    }
+
+    for (int i = 0; i < n; ++i) {
+        restrict_bounds(S, scope[i], intervals[i].min, intervals[i].max);
+        if (is_empty(S.domains[scope[i]])) return false;
+    }
+    return true;
+}
+
+// Compact-table: a reversible sparse bitset of the valid tuples, whose
+// non-zero words are kept first in index, intersected with the supports of
+// the values left in the domains that changed since the last call.
+bool propagate_table(const Constraint& constraint, search_state& S) {
+    stack_frame_on(*S.stack);
+    auto& stack      = *S.stack;
+    auto& D          = S.domains;
+    auto& scope      = constraint.scope;
+    int   n          = scope.count;
+    int   w          = num_words(constraint.constants.count / n);
+    auto  data       = S.tables.data + S.table_start[S.propagating];
+    auto& live       = data[0];
+    auto  last_sizes = data + 1;
+    auto  words      = data + 1 + n;
+    auto  index      = words + w;
+    auto  residues   = S.residues.data + S.residue_start[S.propagating];
+
+    auto supports = allocate<uint64_t*>(n, stack);
+    supports[0]   = constraint.supports.data;
+    for (int i = 1; i < n; ++i)
+        supports[i] = supports[i - 1] + 64 * D[scope[i - 1]].num_words * w;
+
+    // Remove the tuples that are no longer valid.
+    auto mask        = allocate<uint64_t>(w, stack);
+    int  num_changed = 0;
+    int  changed     = -1;
+    for (int i = 0; i < n; ++i) {
+        auto& d    = D[scope[i]];
+        int   size = d.size();
+        if (size == (int)last_sizes[i]) continue;
+        // Before the first call the values are not known to have supports.
+        if ((int)last_sizes[i] > 64 * d.num_words) num_changed += n;
+        num_changed += 1;
+        changed = i;
+        set_trailed(S, last_sizes[i], size);
+
+        for (int k = 0; k < (int)live; ++k) mask[index[k]] = 0;
+        for (int v : d) {
+            auto support = supports[i] + (v - d.offset) * w;
+            for (int k = 0; k < (int)live; ++k)
+                mask[index[k]] |= support[index[k]];
+        }
+        int count = (int)live;
+        for (int k = count - 1; k >= 0; --k) {
+            int  j    = (int)index[k];
+            auto word = words[j] & mask[j];
+            if (word == words[j]) continue;
+            set_trailed(S, words[j], word);
+            if (word != 0) continue;
+            count -= 1;
+            index[k]     = index[count];
+            index[count] = j;
+        }
+        set_trailed(S, live, count);
+        if (count == 0) return false;
+    }
+
+    // Remove the values without a valid tuple. The valid tuples do not change
+    // while doing so. If only one variable changed, its values kept the
+    // supports they had in the last call.
+    for (int i = 0; i < n; ++i) {
+        auto& d = D[scope[i]];
+        residues += 64 * (i > 0 ? D[scope[i - 1]].num_words : 0);
+        if (num_changed == 1 and i == changed) continue;
+        for (int v : d) {
+            auto support = supports[i] + (v - d.offset) * w;
+            int& residue = residues[v - d.offset];
+            if (residue != NO_SUPPORT and (words[residue] & support[residue]))
+                continue;
+
+            bool found = false;
+            for (int k = 0; k < (int)live; ++k) {
+                int j = (int)index[k];
+                if (words[j] & support[j]) {
+                    residue = j;
+                    found   = true;
+                    break;
+                }
+            }
+            if (not found) remove_value(S, scope[i], v);
+        }
+        if (is_empty(d)) return false;
+        set_trailed(S, last_sizes[i], d.size());
+    }
+    return true;
+}
+
+void compile_tables(CSP& csp, size_t max_bytes) {
+    auto& D    = csp.domains;
+    int   v[2] = {0, 0};
+    for (auto& c : csp.constraints) {
+        if (c.eval_custom == nullptr) continue;
+
+        if (c.type == Constraint::UNARY) {
+            auto& d      = D[c.scope[0]];
+            auto  values = array<int>(v, 1);
+            if (d.num_words * sizeof(uint64_t) > max_bytes) continue;
+            c.supports = allocate<uint64_t>(d.num_words, uint64_t(0));
+            for (int a : d) {
+                v[0] = a;
+                if (c.eval_custom(c, values))
+                    c.supports[(a - d.offset) / 64] |= bit(a - d.offset);
+            }
+        }
+
+        if (c.type == Constraint::BINARY) {
+            // A row of bits in the layout of x1 for every value of x0,
+            // followed by a row in the layout of x0 for every value of x1.
+            auto& d0     = D[c.scope[0]];
+            auto& d1     = D[c.scope[1]];
+            auto  values = array<int>(v, 2);
+            int   size   = 2 * 64 * d0.num_words * d1.num_words;
+            if (size * sizeof(uint64_t) > max_bytes) continue;
+            c.supports = allocate<uint64_t>(size, uint64_t(0));
+            auto rows0 = c.supports.data;
+            auto rows1 = rows0 + 64 * d0.num_words * d1.num_words;
+            for (int a : d0) {
+                for (int b : d1) {
+                    v[0] = a;
+                    v[1] = b;
+                    if (not c.eval_custom(c, values)) continue;
+                    int i = a - d0.offset, k = b - d1.offset;
+                    rows0[i * d1.num_words + k / 64] |= bit(k);
+                    rows1[k * d0.num_words + i / 64] |= bit(i);
+                }
+            }
+        }
+    }
+}
+
+void print_wipeouts(const CSP& csp, const search_stats& stats, int count) {
+#if CSP_PROFILE
+    stack_frame();
+    auto& wipeouts = stats.profile.wipeouts;
+    auto  order    = make_range(wipeouts.count);
+    sort(order, [&](int a, int b) { return wipeouts[a] > wipeouts[b]; });
+    printf("Constraints that failed most:\n");
+    for (int i = 0; i < order.count and i < count; ++i) {
+        int c = order[i];
+        if (wipeouts[c] == 0) break;
+        printf("   %8d  ", wipeouts[c]);
+        print_constraint(csp.constraints[c]);
+        printf("\n");
+    }
+    printf("\n");
+#else
+    (void)csp, (void)stats, (void)count;
+#endif
+}
+
+struct trace_file {
+    FILE*            file;
+    std::mutex       mutex;
+    std::atomic<int> threads = {0};
+};
+
+trace_file* open_trace(const char* filename, const CSP& csp) {
+    auto file = fopen(filename, "wb");
+    if (not file) return nullptr;
+    uint32_t header[5] = {0, 0, 1, (uint32_t)csp.domains.count,
+                          (uint32_t)csp.constraints.count};
+    memcpy(header, "CSPTRACE", 8);
+    fwrite(header, sizeof(header), 1, file);
+    for (auto& c : csp.constraints)
+        fwrite(c.name, strlen(c.name) + 1, 1, file);
+
+    auto trace  = new trace_file{};
+    trace->file = file;
+    return trace;
+}
+
+void close_trace(trace_file* trace) {
+    if (not trace) return;
+    fclose(trace->file);
+    delete trace;
+}
+
+int trace_thread(trace_file* trace) { return trace->threads++; }
+
+void flush_trace(search_state& S) {
+    auto& events = S.trace_events;
+    if (events.count == 0) return;
+    auto trace = S.options.trace;
+    {
+        uint32_t block[2] = {(uint32_t)S.trace_thread, (uint32_t)events.count};
+        std::lock_guard<std::mutex> lock(trace->mutex);
+        fwrite(block, sizeof(block), 1, trace->file);
+        fwrite(events.data, sizeof(trace_event), events.count, trace->file);
+    }
+    events.count = 0;
+}
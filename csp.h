@@ -1,63 +1,587 @@
 #pragma once
+#include <limits.h>
+
+#include <atomic>
+
+#include "utils/bitset.h"
+#include "utils/cycles.h"
+#include "utils/random.h"
 #include "utils/stack_allocator.h"
 #include "utils/string.h"
 using namespace giacomo;
 
+// Detailed statistics of the search, see search_profile. Compile with
+// CSP_PROFILE=1 to collect them, otherwise they take neither space nor time.
+#ifndef CSP_PROFILE
+#define CSP_PROFILE 0
+#endif
+
+#if CSP_PROFILE
+#define profile_cycles(counter) giacomo::cycle_timer _timer(counter);
+#else
+#define profile_cycles(counter)
+#endif
+
+struct constraint_kernels;
+
 struct Constraint {
-    enum type { ALL_DIFFERENT, BINARY, NARY, UNARY };
+    enum type { ALL_DIFFERENT, BINARY, NARY, UNARY, TABLE };
+
+    // Strength of the filtering, for constraints that offer more than one.
+    enum consistency {
+        FORWARD_CHECKING,
+        BOUNDS_CONSISTENCY,
+        DOMAIN_CONSISTENCY
+    };
 
-    string     name;
-    array<int> scope;
-    array<int> constants;
-    type       type;
+    const char* name = nullptr;  // interned, see intern_name()
+    array<int>  scope;
+    array<int>  constants;
+    type        type;
+    consistency consistency = FORWARD_CHECKING;
     bool (*eval_custom)(const Constraint&, const array<int>&) = nullptr;
 
-    inline Constraint(enum type t, const array<int>& vars, const string& s);
+    // eval_custom tabulated over the initial domains, see compile_tables().
+    // For a table, the bitset of the tuples that support each value of each
+    // variable of the scope, built by finalize_csp().
+    array<uint64_t> supports;
+
+    // Generated for a predicate known at compile time, see binary_constraint().
+    const constraint_kernels* kernels = nullptr;
+
+    inline Constraint(enum type t, const array<int>& vars, const char* name);
+};
+
+// Copy of a name, stored once for the whole program. Constraints with the
+// same name share it.
+const char* intern_name(const char* name);
+
+// Domains are bitsets over the values [offset, offset + 64 * num_words).
+// Domains with up to 64 values are stored inline in a single word, larger
+// domains point to words allocated on the stack allocator.
+struct Domain {
+    int       offset    = 0;
+    int       num_words = 0;
+    uint64_t  bits      = 0;
+    uint64_t* data      = nullptr;
+
+    inline uint64_t*       words() { return num_words == 1 ? &bits : data; }
+    inline const uint64_t* words() const {
+        return num_words == 1 ? &bits : data;
+    }
+
+    inline int  size() const;
+    inline bool contains(int value) const;
+    inline int  min() const;
+    inline int  max() const;
+    inline int  value() const { return min(); }
+
+    // iterate over the values in the domain, in increasing order
+    struct const_iterator {
+        const uint64_t* words;
+        int             num_words;
+        int             offset;
+        int             word;
+        uint64_t        bits;
+
+        const_iterator& operator++() {
+            bits &= bits - 1;
+            while (bits == 0 and ++word < num_words) bits = words[word];
+            return *this;
+        }
+        bool operator!=(const const_iterator& other) const {
+            return word != other.word or bits != other.bits;
+        }
+        int operator*() const {
+            return offset + 64 * word + count_trailing_zeros(bits);
+        }
+    };
+    inline const_iterator begin() const {
+        auto it = const_iterator{words(), num_words, offset, 0, 0};
+        if (num_words == 0) return it;
+        it.bits = it.words[0];
+        while (it.bits == 0 and ++it.word < num_words)
+            it.bits = it.words[it.word];
+        return it;
+    }
+    inline const_iterator end() const {
+        return const_iterator{words(), num_words, offset, num_words, 0};
+    }
+};
+
+// Events that happen on a domain when it changes. Constraints are propagated
+// only after the events they watch happen on a variable of their scope.
+enum domain_event {
+    DOMAIN_CHANGED = 1 << 0,  // some value was removed
+    BOUNDS_CHANGED = 1 << 1,  // the min or the max value was removed
+    VALUE_FIXED    = 1 << 2,  // only one value is left
+};
+
+// Entry of the trail: the previous content of a word of a domain, or of a
+// word of propagator state if variable is -1. reason tells why a domain
+// changed, for the conflict analysis of learn_nogoods: the propagator that
+// changed it, or one of the codes below.
+struct trail_entry {
+    enum reason_code {
+        DECISION  = -1,  // the decision of its level
+        OBJECTIVE = -2,  // the bound, which depends on every decision
+        NOGOOD    = -3,  // NOGOOD - g for the learned nogood g
+    };
+    int       variable;
+    int       reason;
+    uint64_t* word;
+    uint64_t  value;
+};
+
+struct assignment {
+    int variable;
+    int value;
+};
+
+struct CSP;
+struct Objective;
+struct optimize_options;
+
+// Event of the binary trace of a search, see open_trace(). depth is the
+// number of save points of the branch, which is the number of decisions
+// except in the tasks of parallel_search(), whose decisions share the first
+// one.
+//   DECISION:    a = variable, b = value
+//   PROPAGATION: a = 1 if it succeeded or 0, b = trail entries of the level
+//   WIPEOUT:     a = failed constraint
+//   BACKTRACK:   all the values of the node below depth failed
+//   SOLUTION:    a complete assignment was found
+//   RESTART:     a = number of the run that starts
+struct trace_event {
+    enum type { DECISION, PROPAGATION, WIPEOUT, BACKTRACK, SOLUTION, RESTART };
+    uint32_t header;  // type | depth << 8
+    int32_t  a, b;
+};
+
+// Events buffered by each search state before they are written.
+const int TRACE_BLOCK_SIZE = 1 << 15;
+
+// File shared by the traces of the searches of all threads.
+struct trace_file;
+
+struct search_options {
+    // Variable selection heuristic. Ties are broken by max degree.
+    //   MRV_DEGREE: minimum remaining values.
+    //   DOM_DEG:    minimum ratio between domain size and degree.
+    //   DOM_WDEG:   minimum ratio between domain size and weighted degree,
+    //               where constraints weigh one plus the number of times they
+    //               wiped out a domain.
+    enum heuristic { MRV_DEGREE, DOM_DEG, DOM_WDEG };
+    heuristic variable_heuristic = MRV_DEGREE;
+
+    // Order in which the values of the chosen variable are tried.
+    enum value_order { RANDOM_VALUES, INCREASING_VALUES };
+    value_order value_heuristic = RANDOM_VALUES;
+
+    // Seed of the random value order. The same seed gives the same search.
+    uint64_t seed = 0;
+
+    // Conflict-directed backjumping and nogood learning. Every failure is
+    // explained by the decisions it depends on, the search jumps back to the
+    // last of them and the failed combinations are remembered as nogoods.
+    // When the database is full, the least active half is forgotten. Used by
+    // search() and solve_portfolio(), not by parallel_search().
+    bool learn_nogoods   = false;
+    int  max_nogoods     = 1 << 12;
+    int  max_nogood_size = 32;  // longer nogoods are not recorded
+
+    // Restarts. The search starts over from the root once it backtracks more
+    // than a limit: restart_base times the terms of the Luby sequence (1, 1,
+    // 2, 1, 1, 2, 4...), or restart_base growing by restart_factor at every
+    // restart. The random values, the learned nogoods and, with keep_weights,
+    // the weights of dom/wdeg carry on to the next run. Used by search() and
+    // solve_portfolio(), not by parallel_search().
+    enum restart_policy { NO_RESTARTS, LUBY_RESTARTS, GEOMETRIC_RESTARTS };
+    restart_policy restarts       = NO_RESTARTS;
+    int            restart_base   = 100;
+    double         restart_factor = 1.5;
+    bool           keep_weights   = true;
+
+    // Phase saving: try first the value each variable was last assigned.
+    bool phase_saving = false;
+
+    // Log the events of the search to a file opened by open_trace(). Each
+    // search state buffers its events and writes them in blocks.
+    trace_file* trace = nullptr;
+};
+
+// Nogoods learned by the search: decisions that cannot hold together. Each
+// nogood watches its first two decisions, which do not both hold, and is
+// visited only when the variable of one of them is fixed, through the list of
+// the watches of each variable.
+struct nogood_database {
+    int               max_size = 0;
+    array<assignment> decisions;    // max_size slots per nogood
+    array<int>        sizes;        // count is the number of nogoods
+    array<float>      activity;     // bumped when they fail or propagate
+    float             increment = 1;
+    array<int>        next_watch;   // 2 * nogood + watch, -1 at the end
+    array<int>        first_watch;  // of each variable
+    int               checked = 0;  // entries of the trail already visited
 };
 
-using Domain = array<int>;
+// Where the work of a search goes, with CSP_PROFILE. Cycles are counted with
+// read_cycles(). The heuristic keeps the unfixed variables in a heap that is
+// updated at every change of a domain, so its time is the one of the heap
+// updates, and it is not counted in the one of the propagators.
+struct search_profile {
+#if CSP_PROFILE
+    static const int num_types = Constraint::TABLE + 1;
+    long long  propagations[num_types] = {};  // calls by constraint type
+    long long  removals[num_types]     = {};  // values removed by them
+    array<int> wipeouts;                      // failures of each constraint
+    int        max_depth        = 0;
+    uint64_t   heuristic_cycles = 0;
+    uint64_t   propagate_cycles = 0;
+    uint64_t   check_cycles     = 0;  // in satisfies() at the leaves
+#endif
+};
+
+// State of the search. Domains are modified in place and the previous content
+// of every changed word is recorded on the trail. Backtracking to a save point
+// restores only what changed after it.
+struct search_state {
+    const CSP*               csp;
+    search_options           options;
+    stack_allocator*         stack;  // temporaries of search and propagation
+    rng                      random;
+    const std::atomic<bool>* stop = nullptr;  // set to cancel the search
+    array<Domain>            domains;
+    array<trail_entry>       trail;
+    array<int>               levels;  // trail size at each save point
+
+    // Propagation queue. A constraint is queued when one of the events it
+    // watches happens on a variable of its scope, at most once at a time.
+    array<int>  watch_events;  // events watched by each constraint
+    array<int>  queue;
+    int         queue_start = 0;
+    array<bool> queued;
+    array<bool> idempotent;  // not queued again by their own changes
+    int         propagating  = -1;  // constraint being propagated
+    long long   propagations = 0;   // calls of the propagators
+
+    // Last support found for each value of the variables of binary
+    // constraints, indexed by residue_start[c] + position of the value in
+    // the domain layout of x0, followed by the ones of x1. For table
+    // constraints, the word of valid tuples where a support was found.
+    array<int> residue_start;
+    array<int> residues;
+
+    // Maximum matchings of the all_different constraints propagated with
+    // domain consistency, kept between calls and repaired incrementally.
+    // From matching_start[c]: smallest value, number of values, the value
+    // matched to each variable and the variable matched to each value.
+    array<int> matching_start;
+    array<int> matchings;
+
+    // Compact-table state of the table constraints. From table_start[c]: the
+    // number of non-zero words of valid tuples, the domain size of each
+    // variable at the last call, the bitset of valid tuples and a permutation
+    // of its words with the non-zero ones first. The first three are trailed.
+    // The supports of the values are shared, in the constraint.
+    array<int>      table_start;
+    array<uint64_t> tables;
+
+    // Unfixed variables, in a binary heap ordered by the variable heuristic,
+    // updated whenever a domain changes or is restored.
+    array<int> heap;
+    array<int> heap_position;  // -1 if not in the heap
+    array<int> weights;        // failure weight of each constraint
+    array<int> weighted_degrees;
+
+    // Conflict analysis, with learn_nogoods. Levels start from 1, and the
+    // decision of each one is in decisions. The levels a failure depends on
+    // are found from the reasons on the trail, see set_conflict(), marking
+    // the variables involved with the last mark. reason is the one of the
+    // changes made outside propagators. conflict is the set of the levels of
+    // the last failure.
+    int               reason = trail_entry::DECISION;
+    array<int>        marks;
+    int               mark = 0;
+    array<uint64_t>   conflict;
+    array<assignment> decisions;
+    nogood_database   nogoods;
 
-inline bool eval(const Constraint& constraint, const array<Domain>& domains);
-inline bool propagate(const Constraint& constraint, array<Domain>& domains);
+    // Restarts and phase saving. The search gives up with restarting set once
+    // the backtracks reach restart_at. phases has the value last assigned to
+    // each variable, or a value out of its domain.
+    long long  restart_at = LLONG_MAX;
+    bool       restarting = false;
+    array<int> phases;
+
+    // Branch and bound, see optimize(). Only solutions that cost less than
+    // bound are searched for, and each one found becomes the new bound and
+    // is copied to best. stopped is set when the caller asks to stop.
+    const Objective*        objective = nullptr;  // minimized
+    const optimize_options* optimize  = nullptr;
+    long long               bound     = LLONG_MAX;
+    array<assignment>       best;
+    bool                    stopped = false;
+
+    // Events not yet written to options.trace, by the thread numbered
+    // trace_thread.
+    array<trace_event> trace_events;
+    int                trace_thread = 0;
+
+    search_profile profile;
+};
+
+inline bool eval(const Constraint& constraint, const array<Domain>& domains,
+                 stack_allocator& stack = default_allocator());
+inline bool propagate(const Constraint& constraint, search_state& state);
+
+// Compressed (CSR) adjacency between variables and constraints. The
+// constraints of variable v are variable_constraints[variable_start[v]] up to
+// variable_constraints[variable_start[v + 1]], and likewise for the variables
+// of a constraint.
+struct Adjacency {
+    array<int> variable_start;
+    array<int> variable_constraints;
+    array<int> constraint_start;
+    array<int> constraint_variables;
+    array<int> degrees;  // number of constraint neighbors of each variable
+};
 
 struct CSP {
     string            name;
     array<Domain>     domains;
     array<Constraint> constraints;
+    Adjacency         adjacency;  // built by finalize_csp()
 };
 
 struct search_stats {
-    int backtracks = 0;
-    int expansions = 0;
+    long long      backtracks   = 0;
+    long long      expansions   = 0;
+    long long      restarts     = 0;
+    long long      propagations = 0;  // calls of the propagators
+    size_t         peak_memory  = 0;  // highest head of the search stacks
+    search_profile profile;           // empty without CSP_PROFILE
 };
 
-struct assignment {
-    int variable;
-    int value;
-};
 using Assignment = array<assignment>;
 
 // Check if assignment satisfies the constraints.
-bool satisfies(const array<Constraint>& C, const array<Domain>& A);
+bool satisfies(const array<Constraint>& C, const array<Domain>& A,
+               stack_allocator& stack = default_allocator());
 
 // Search satisfying assignment.
-bool search(const array<Constraint>& C, array<Domain>& D, int depth,
-            search_stats& stats);
+bool search(search_state& S, int depth, search_stats& stats);
+
+// Search from the root of the state, restarting as the options say.
+bool search_with_restarts(search_state& S, search_stats& stats);
 
+// The search works on the given allocator, where the solution is returned.
+// Searches on different allocators can run on different threads.
 Assignment search(const CSP& csp, const Assignment& assignment,
-                  search_stats& stats);
+                  search_stats& stats, const search_options& options = {},
+                  stack_allocator& stack = default_allocator());
+
+// Run one search per worker in parallel threads, each with its own options
+// and an arena starting at arena_size bytes. The first solution found is
+// returned and the other workers are stopped. The result is empty if there
+// is no solution. The stats are summed over the workers, of which there must
+// be at least one. In a worker, default_allocator() is on the worker arena.
+Assignment solve_portfolio(const CSP&                    csp,
+                           const array<search_options>& workers,
+                           search_stats&                 stats,
+                           size_t           arena_size = size_t(1) << 20,
+                           stack_allocator& stack      = default_allocator());
+
+// Portfolio of workers with the same options, with seeds seed, seed + 1...
+// At least one worker runs.
+Assignment solve_portfolio(const CSP& csp, int num_threads,
+                           search_stats&         stats,
+                           const search_options& options    = {},
+                           size_t                arena_size = size_t(1) << 20,
+                           stack_allocator& stack = default_allocator());
+
+struct enumerate_options {
+    long long      max_solutions = -1;  // all of them if negative
+    search_options search        = {};  // without nogoods and restarts
+
+    // Check every solution against all the constraints. The propagators
+    // already reject the fixed values that violate their constraint, so this
+    // can be turned off when counting.
+    bool check_solutions = true;
+
+    // Called for every solution with the domains, all fixed, which stay
+    // valid only during the call. Returning false stops the search. Without
+    // it, the solutions are only counted.
+    bool (*on_solution)(const array<Domain>& domains, void* data) = nullptr;
+    void* data = nullptr;
+};
+
+// Visit the solutions of a CSP in the order of the search, without building
+// assignments. Returns the number of solutions visited.
+long long enumerate_solutions(const CSP& csp, const enumerate_options& options,
+                              search_stats&    stats,
+                              stack_allocator& stack = default_allocator());
+
+// Objective of optimize(): the sum of the cost of the value of some
+// variables. The cost of value v of variables[i] is costs[i][v - offset],
+// with the offset of its initial domain.
+struct Objective {
+    array<int>        variables;
+    array<array<int>> costs;
+};
+
+// Objective with the costs cost(variable, value).
+template <typename Cost>
+inline Objective make_objective(const CSP& csp, const array<int>& variables,
+                                const Cost&      cost,
+                                stack_allocator& stack = default_allocator());
+
+// Objective that sums weights[i] * value over the variables.
+inline Objective weighted_sum(const CSP& csp, const array<int>& variables,
+                              const array<int>& weights,
+                              stack_allocator&  stack = default_allocator());
+
+struct optimize_options {
+    bool           maximize = false;
+    search_options search   = {};
+
+    // Called with every solution better than the ones before, as soon as it
+    // is found. Returning false stops the search, which returns the best
+    // solution so far.
+    bool (*on_solution)(const Assignment& solution, long long cost,
+                        void* data) = nullptr;
+    void* data = nullptr;
+
+    // Set by another thread to stop the search, e.g. at a deadline, even when
+    // no better solution comes.
+    const std::atomic<bool>* stop = nullptr;
+};
+
+// Branch and bound. Search solutions that are better and better, propagating
+// the bound on the objective, until the best one is proven, the callback
+// stops the search or stop is set. Returns the best solution found, empty if
+// none, and its cost in cost, if given.
+Assignment optimize(const CSP& csp, const Objective& objective,
+                    const optimize_options& options, search_stats& stats,
+                    long long*       cost  = nullptr,
+                    stack_allocator& stack = default_allocator());
+
+// Remove the values that would make the objective reach the bound.
+bool propagate_objective(search_state& S);
+
+struct parallel_options {
+    // FIRST_SOLUTION stops at the first solution, ALL_SOLUTIONS reports every
+    // solution to on_solution, COUNT_SOLUTIONS only counts them.
+    enum mode { FIRST_SOLUTION, ALL_SOLUTIONS, COUNT_SOLUTIONS };
+    mode           mode        = FIRST_SOLUTION;
+    int            num_threads = 1;  // at least one runs
+    size_t         arena_size  = size_t(1) << 20;  // initial, of each worker
+    search_options search      = {};
+
+    // Called for every solution in ALL_SOLUTIONS mode, one call at a time,
+    // by a worker whose default_allocator() is on its own arena.
+    void (*on_solution)(const Assignment& solution, void* data) = nullptr;
+    void* data = nullptr;
+};
+
+// Search the tree of a single CSP with several threads. The tree is split
+// into subproblems, identified by the decisions that lead to them, which idle
+// workers steal from the busy ones. Returns the number of solutions found.
+// In FIRST_SOLUTION mode the solution is returned in solution, if given.
+long long parallel_search(const CSP& csp, const parallel_options& options,
+                          search_stats& stats, Assignment* solution = nullptr,
+                          stack_allocator& stack = default_allocator());
+
+// Options of solve_batch().
+struct batch_options {
+    int            num_threads = 1;  // at least one runs
+    size_t         arena_size  = size_t(1) << 20;  // initial, of each worker
+    search_options search      = {};  // instance i is searched with seed + i
+
+    // Narrow domains, which come as the ones of the model, to the initial
+    // domains of instance i. Returns false if there is no instance i, which
+    // ends the batch. Called by several threads at once, with different i.
+    bool (*get_instance)(long long i, array<Domain>& domains,
+                         void* data) = nullptr;
+
+    // Receives the solution of each instance, empty if it has none, in the
+    // order of the instances if ordered is set, or else as soon as they are
+    // solved. Called by one thread at a time. Both callbacks run in worker
+    // threads, whose default_allocator() is on the arena of the worker.
+    bool ordered = true;
+    void (*on_solution)(long long i, const Assignment& solution,
+                        void* data) = nullptr;
+    void* data                      = nullptr;
+};
+
+// Solve many instances of the same model, which differ only in their initial
+// domains, such as sudokus with different clues. The model is finalized once,
+// and each worker thread reuses its arena and search state for all the
+// instances it solves. The solution of an instance does not depend on the
+// thread that solves it. Returns the number of instances.
+long long solve_batch(const CSP& csp, const batch_options& options,
+                      search_stats&    stats,
+                      stack_allocator& stack = default_allocator());
+
+// Binary trace of searches. The file starts with the magic "CSPTRACE", the
+// version, the number of variables and of constraints (uint32 each) and the
+// name of each constraint, null terminated. Then come blocks of events, each
+// made of the thread that logged them and their number (uint32 each), and
+// the events. Returns nullptr if the file cannot be created.
+trace_file* open_trace(const char* filename, const CSP& csp);
+void        close_trace(trace_file* trace);
+
+// Number of a new thread that logs to a trace.
+int trace_thread(trace_file* trace);
+
+// Write the buffered events of a search.
+void flush_trace(search_state& S);
+
+// Log an event of the search, if it is traced.
+inline void trace(search_state& S, enum trace_event::type type, int a = 0,
+                  int b = 0) {
+    if (not S.options.trace) return;
+    if (S.trace_events.count == TRACE_BLOCK_SIZE) flush_trace(S);
+    auto header = uint32_t(type) | uint32_t(S.levels.count) << 8;
+    S.trace_events.push_back({header, a, b});
+}
 
 bool search_single_constraint(const Constraint& c, const array<Domain>& D,
-                              int depth);
+                              int depth,
+                              stack_allocator& stack = default_allocator());
+
+// Generalized arc consistency for all_different, see all_different().
+bool propagate_all_different_matching(const Constraint& constraint,
+                                      search_state&     S);
+
+// Bounds consistency for all_different, see all_different().
+bool propagate_all_different_bounds(const Constraint& constraint,
+                                    search_state&     S);
 
-// Choose next variable to assign (MRV & MaxDegree heuristics).
-int choose_variable(const array<Domain>& D, const array<Constraint>& C);
+// Generalized arc consistency for table constraints, see table().
+bool propagate_table(const Constraint& constraint, search_state& S);
+
+// Choose next variable to assign (MRV & MaxDegree heuristics by default).
+int choose_variable(const search_state& S);
 
 // Propagate consequences after assignment in order to reduce domains.
-bool constraints_propagation(const array<Constraint>& C, array<Domain>& D);
-bool gac3(const array<Constraint>& C, array<Domain>& D);
+// Queued constraints are propagated until no domain changes.
+bool constraints_propagation(search_state& S);
+bool gac3(search_state& S);
+
+// Remove the values excluded by the learned nogoods, given the variables
+// fixed since the last call. Fails if a nogood holds, see learn_nogoods.
+bool propagate_nogoods(search_state& S);
+
+// Set the conflict of a failure to the levels whose decisions imply the values
+// removed from the domains of some variables.
+void set_conflict(search_state& S, const array<int>& variables);
+
+// Remember the decisions of the levels in conflict as a nogood. The decision
+// of the last of them must have just been undone.
+void learn_nogood(search_state& S, const array<uint64_t>& conflict);
 bool remove_values(int variable, const Constraint& constraint, array<Domain>& D,
-                   array<Domain> A);
+                   stack_allocator& stack = default_allocator());
 
 // Initialize CSP.
 inline CSP make_csp(const string& name, const array<Domain>& domains,
@@ -70,6 +594,34 @@ inline CSP make_csp(const string& name, const array<Domain>& domains,
     return csp;
 }
 
+// Build the adjacency index and pack the scopes and constants of the
+// constraints one after the other. Must be called once all the constraints
+// have been added, before searching. The supports of table constraints are
+// indexed over the domains at this point: later domains must keep their
+// offsets and sizes in words.
+void finalize_csp(CSP& csp);
+
+// Evaluate the custom predicates of unary and binary constraints once over
+// the initial domains and store them as bitsets, so they are propagated with
+// bitwise operations. Tables larger than max_bytes are not built and those
+// constraints keep calling their predicate. After this, values can only be
+// removed from the domains.
+void compile_tables(CSP& csp, size_t max_bytes = 1 << 16);
+
+inline array<int> constraints_of(const CSP& csp, int variable) {
+    auto& adj   = csp.adjacency;
+    int   start = adj.variable_start[variable];
+    int   end   = adj.variable_start[variable + 1];
+    return {adj.variable_constraints.data + start, end - start};
+}
+
+inline array<int> variables_of(const CSP& csp, int constraint) {
+    auto& adj   = csp.adjacency;
+    int   start = adj.constraint_start[constraint];
+    int   end   = adj.constraint_start[constraint + 1];
+    return {adj.constraint_variables.data + start, end - start};
+}
+
 // Useful functions to initialize domains.
 inline array<int> make_range(int from, int to) {
     auto result = allocate<int>(to - from);
@@ -79,6 +631,647 @@ inline array<int> make_range(int from, int to) {
 
 inline array<int> make_range(int to) { return make_range(0, to); }
 
+// Domain functions.
+inline int Domain::size() const {
+    if (num_words == 1) return popcount(bits);
+    int result = 0;
+    for (int i = 0; i < num_words; ++i) result += popcount(data[i]);
+    return result;
+}
+
+inline bool Domain::contains(int value) const {
+    int i = value - offset;
+    if (i < 0 or i >= 64 * num_words) return false;
+    return (words()[i / 64] & bit(i)) != 0;
+}
+
+inline int Domain::min() const {
+    auto w = words();
+    for (int i = 0; i < num_words; ++i)
+        if (w[i]) return offset + 64 * i + count_trailing_zeros(w[i]);
+    assert(0 && "empty domain");
+    return offset;
+}
+
+inline int Domain::max() const {
+    auto w = words();
+    for (int i = num_words - 1; i >= 0; --i)
+        if (w[i]) return offset + 64 * i + 63 - count_leading_zeros(w[i]);
+    assert(0 && "empty domain");
+    return offset;
+}
+
+inline bool contains(const Domain& d, int value) { return d.contains(value); }
+
+inline bool is_empty(const Domain& d) {
+    auto w = d.words();
+    for (int i = 0; i < d.num_words; ++i)
+        if (w[i]) return false;
+    return true;
+}
+
+// Make an empty domain able to hold the values in [from, to).
+inline Domain make_empty_domain(int from, int to,
+                                stack_allocator& stack = default_allocator()) {
+    auto result      = Domain{};
+    result.offset    = from;
+    result.num_words = num_words(to - from);
+    if (result.num_words < 1) result.num_words = 1;
+    if (result.num_words > 1) {
+        auto words  = allocate<uint64_t>(result.num_words, uint64_t(0), stack);
+        result.data = words.data;
+    }
+    return result;
+}
+
+// Make an empty domain with the same layout of another one.
+inline Domain make_empty_like(const Domain& d,
+                              stack_allocator& stack = default_allocator()) {
+    return make_empty_domain(d.offset, d.offset + 64 * d.num_words, stack);
+}
+
+// Make domain with values in [from, to).
+inline Domain make_domain(int from, int to,
+                          stack_allocator& stack = default_allocator()) {
+    auto result = make_empty_domain(from, to, stack);
+    auto words  = result.words();
+    for (int i = 0; i < to - from; ++i) words[i / 64] |= bit(i);
+    return result;
+}
+
+inline Domain make_domain(const array<int>& values,
+                          stack_allocator& stack = default_allocator()) {
+    assert(values.count > 0);
+    int min_value = values[0], max_value = values[0];
+    for (int v : values) {
+        if (v < min_value) min_value = v;
+        if (v > max_value) max_value = v;
+    }
+    auto result = make_empty_domain(min_value, max_value + 1, stack);
+    auto words  = result.words();
+    for (int v : values) words[(v - min_value) / 64] |= bit(v - min_value);
+    return result;
+}
+
+// Add a value to the domain. The value must fit in the domain's layout.
+inline void insert(Domain& d, int value) {
+    int i = value - d.offset;
+    assert(i >= 0 and i < 64 * d.num_words);
+    d.words()[i / 64] |= bit(i);
+}
+
+// Remove a value from the domain. Returns true if the domain changed.
+inline bool remove(Domain& d, int value) {
+    int i = value - d.offset;
+    if (i < 0 or i >= 64 * d.num_words) return false;
+    auto& word = d.words()[i / 64];
+    if ((word & bit(i)) == 0) return false;
+    word &= ~bit(i);
+    return true;
+}
+
+// Reduce the domain to a single value.
+inline void fix(Domain& d, int value) {
+    auto words = d.words();
+    for (int i = 0; i < d.num_words; ++i) words[i] = 0;
+    insert(d, value);
+}
+
+// Keep only the values that are also in mask, which must have the same
+// layout. Returns true if the domain changed.
+inline bool intersect(Domain& d, const Domain& mask) {
+    assert(d.offset == mask.offset and d.num_words == mask.num_words);
+    auto     words   = d.words();
+    auto     other   = mask.words();
+    uint64_t changed = 0;
+    for (int i = 0; i < d.num_words; ++i) {
+        changed |= words[i] & ~other[i];
+        words[i] &= other[i];
+    }
+    return changed != 0;
+}
+
+// Remove the values that are in mask, which must have the same layout.
+// Returns true if the domain changed.
+inline bool subtract(Domain& d, const Domain& mask) {
+    assert(d.offset == mask.offset and d.num_words == mask.num_words);
+    auto     words   = d.words();
+    auto     other   = mask.words();
+    uint64_t changed = 0;
+    for (int i = 0; i < d.num_words; ++i) {
+        changed |= words[i] & other[i];
+        words[i] &= ~other[i];
+    }
+    return changed != 0;
+}
+
+// Copy the values of a domain to another one with the same layout.
+inline void copy_to(const Domain& from, Domain& to) {
+    assert(from.offset == to.offset and from.num_words == to.num_words);
+    if (from.num_words == 1) {
+        to.bits = from.bits;
+        return;
+    }
+    for (int i = 0; i < from.num_words; ++i) to.data[i] = from.data[i];
+}
+
+inline Domain copy(const Domain& d,
+                   stack_allocator& stack = default_allocator()) {
+    auto result = d;
+    if (d.num_words > 1) {
+        result.data = allocate<uint64_t>(d.num_words, stack).data;
+        copy_to(d, result);
+    }
+    return result;
+}
+
+inline array<Domain> copy(const array<Domain>& domains,
+                          stack_allocator&     stack = default_allocator()) {
+    auto result = allocate<Domain>(domains.count, stack);
+    for (int i = 0; i < domains.count; ++i) result[i] = copy(domains[i], stack);
+    return result;
+}
+
+inline void copy_to(const array<Domain>& from, array<Domain>& to) {
+    assert(from.count <= to.count);
+    for (int i = 0; i < from.count; ++i) copy_to(from[i], to[i]);
+    to.count = from.count;
+}
+
+// Values of a domain as an array.
+inline array<int> domain_values(const Domain& d,
+                                stack_allocator& stack = default_allocator()) {
+    auto result  = allocate<int>(d.size(), stack);
+    result.count = 0;
+    for (int v : d) result.push_back(v);
+    return result;
+}
+
+// Constraints whose propagation reaches a fixpoint in a single call, so they
+// are not queued again by the changes they make.
+inline bool is_idempotent(const Constraint& constraint) {
+    // The bounds propagator of all_different is not, because the new bounds
+    // may fall into holes of the domains.
+    if (constraint.type == Constraint::TABLE) return true;
+    return constraint.type == Constraint::ALL_DIFFERENT and
+           constraint.consistency == Constraint::DOMAIN_CONSISTENCY;
+}
+
+// Events that trigger the propagation of a constraint.
+inline int watched_events(const Constraint& constraint) {
+    switch (constraint.type) {
+        case Constraint::ALL_DIFFERENT:
+            if (constraint.consistency == Constraint::DOMAIN_CONSISTENCY)
+                return DOMAIN_CHANGED;
+            if (constraint.consistency == Constraint::BOUNDS_CONSISTENCY)
+                return BOUNDS_CHANGED;
+            return VALUE_FIXED;
+        case Constraint::BINARY: return DOMAIN_CHANGED;
+        case Constraint::NARY: return VALUE_FIXED;
+        case Constraint::UNARY: return 0;  // Filtered once, at the root.
+        case Constraint::TABLE: return DOMAIN_CHANGED;
+    }
+    return DOMAIN_CHANGED;
+}
+
+// Search state functions.
+// Marks values whose residual support is not known yet.
+const int NO_SUPPORT = INT_MIN;
+
+// Variable selection heap.
+inline bool heap_less(const search_state& S, int a, int b) {
+    auto& degrees = S.csp->adjacency.degrees;
+    long  size_a  = S.domains[a].size();
+    long  size_b  = S.domains[b].size();
+    long  deg_a   = degrees[a];
+    long  deg_b   = degrees[b];
+    if (S.options.variable_heuristic == search_options::DOM_WDEG) {
+        deg_a = S.weighted_degrees[a];
+        deg_b = S.weighted_degrees[b];
+    }
+    if (S.options.variable_heuristic != search_options::MRV_DEGREE) {
+        // Compare size_a / deg_a < size_b / deg_b, zero degree last.
+        if (deg_a == 0 or deg_b == 0) {
+            if (deg_a != deg_b) return deg_b == 0;
+        } else if (size_a * deg_b != size_b * deg_a) {
+            return size_a * deg_b < size_b * deg_a;
+        }
+    }
+    if (size_a != size_b) return size_a < size_b;
+    if (degrees[a] != degrees[b]) return degrees[a] > degrees[b];
+    return a < b;
+}
+
+inline void heap_swap(search_state& S, int i, int k) {
+    int a              = S.heap[i];
+    int b              = S.heap[k];
+    S.heap[i]          = b;
+    S.heap[k]          = a;
+    S.heap_position[b] = i;
+    S.heap_position[a] = k;
+}
+
+inline void heap_sift_up(search_state& S, int i) {
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (not heap_less(S, S.heap[i], S.heap[parent])) break;
+        heap_swap(S, i, parent);
+        i = parent;
+    }
+}
+
+inline void heap_sift_down(search_state& S, int i) {
+    while (true) {
+        int best  = i;
+        int left  = 2 * i + 1;
+        int right = 2 * i + 2;
+        if (left < S.heap.count and heap_less(S, S.heap[left], S.heap[best]))
+            best = left;
+        if (right < S.heap.count and heap_less(S, S.heap[right], S.heap[best]))
+            best = right;
+        if (best == i) break;
+        heap_swap(S, i, best);
+        i = best;
+    }
+}
+
+// Move a variable in the heap after its domain changed. Variables with one or
+// zero values left are not in the heap.
+inline void heap_update(search_state& S, int variable) {
+    profile_cycles(S.profile.heuristic_cycles);
+    int  i       = S.heap_position[variable];
+    bool unfixed = S.domains[variable].size() > 1;
+    if (i == -1) {
+        if (not unfixed) return;
+        S.heap_position[variable] = S.heap.count;
+        S.heap.push_back(variable);
+        heap_sift_up(S, S.heap.count - 1);
+    } else if (not unfixed) {
+        heap_swap(S, i, S.heap.count - 1);
+        S.heap.count -= 1;
+        S.heap_position[variable] = -1;
+        if (i < S.heap.count) {
+            heap_sift_up(S, i);
+            heap_sift_down(S, i);
+        }
+    } else {
+        heap_sift_up(S, i);
+        heap_sift_down(S, i);
+    }
+}
+
+// Increase the weight of a constraint that caused a failure.
+inline void bump_weight(search_state& S, int constraint) {
+    S.weights[constraint] += 1;
+    for (int v : variables_of(*S.csp, constraint)) {
+        S.weighted_degrees[v] += 1;
+        if (S.options.variable_heuristic != search_options::DOM_WDEG) continue;
+        if (S.heap_position[v] != -1) heap_sift_up(S, S.heap_position[v]);
+    }
+}
+
+inline search_state make_search_state(
+    const CSP& csp, const search_options& options = {},
+    stack_allocator& stack = default_allocator()) {
+    assert(csp.adjacency.variable_start.count == csp.domains.count + 1 &&
+           "finalize_csp() must be called before searching");
+    auto& domains     = csp.domains;
+    auto& constraints = csp.constraints;
+
+    auto S    = search_state{};
+    S.csp     = &csp;
+    S.options = options;
+    S.stack   = &stack;
+    S.random  = make_rng(options.seed);
+    S.domains = copy(domains, stack);
+
+    S.watch_events = allocate<int>(constraints.count, stack);
+    for (int c = 0; c < constraints.count; ++c)
+        S.watch_events[c] = watched_events(constraints[c]);
+
+    S.queue       = allocate<int>(constraints.count, stack);
+    S.queue.count = 0;
+    S.queued      = allocate<bool>(constraints.count, false, stack);
+    S.idempotent  = allocate<bool>(constraints.count, false, stack);
+    for (int c = 0; c < constraints.count; ++c)
+        S.idempotent[c] = is_idempotent(constraints[c]);
+
+    // Every entry of the trail removes at least one value from a domain, so
+    // the trail never holds more entries than the initial domain sizes. Table
+    // constraints also trail words that lose at least one tuple, the number
+    // of non-zero words and the last domain sizes, which only decrease.
+    int capacity = 0;
+    for (auto& d : domains) capacity += d.size();
+    for (auto& c : constraints) {
+        if (c.type != Constraint::TABLE) continue;
+        int num_tuples = c.constants.count / c.scope.count;
+        capacity += num_tuples + num_words(num_tuples);
+        for (int v : c.scope) capacity += domains[v].size() + 1;
+    }
+    S.trail        = allocate<trail_entry>(capacity, stack);
+    S.trail.count  = 0;
+    S.levels       = allocate<int>(domains.count + 1, stack);
+    S.levels.count = 0;
+
+    // Residual supports of binary and table constraints.
+    S.residue_start = allocate<int>(constraints.count, -1, stack);
+    int num_residues = 0;
+    for (int c = 0; c < constraints.count; ++c) {
+        if (constraints[c].type != Constraint::BINARY and
+            constraints[c].type != Constraint::TABLE)
+            continue;
+        S.residue_start[c] = num_residues;
+        for (int v : constraints[c].scope)
+            num_residues += 64 * domains[v].num_words;
+    }
+    S.residues = allocate<int>(num_residues, NO_SUPPORT, stack);
+
+    // Matchings of all_different constraints.
+    auto uses_matching = [](const Constraint& c) {
+        return c.type == Constraint::ALL_DIFFERENT and
+               c.consistency == Constraint::DOMAIN_CONSISTENCY;
+    };
+    auto min_value = [&](const Constraint& c) {
+        int result = INT_MAX;
+        for (int v : c.scope)
+            if (domains[v].min() < result) result = domains[v].min();
+        return result;
+    };
+    auto num_values = [&](const Constraint& c) {
+        int max = INT_MIN;
+        for (int v : c.scope)
+            if (domains[v].max() > max) max = domains[v].max();
+        return max - min_value(c) + 1;
+    };
+    S.matching_start  = allocate<int>(constraints.count, -1, stack);
+    int num_matchings = 0;
+    for (int c = 0; c < constraints.count; ++c) {
+        if (not uses_matching(constraints[c])) continue;
+        S.matching_start[c] = num_matchings;
+        num_matchings += 2 + constraints[c].scope.count;
+        num_matchings += num_values(constraints[c]);
+    }
+    S.matchings = allocate<int>(num_matchings, stack);
+    for (int c = 0; c < constraints.count; ++c) {
+        if (not uses_matching(constraints[c])) continue;
+        int* m = S.matchings.data + S.matching_start[c];
+        int  n = constraints[c].scope.count;
+        m[0]   = min_value(constraints[c]);
+        m[1]   = num_values(constraints[c]);
+        for (int i = 0; i < n; ++i) m[2 + i] = NO_SUPPORT;
+        for (int i = 0; i < m[1]; ++i) m[2 + n + i] = -1;
+    }
+
+    // Valid tuples of table constraints. The last sizes start out of range,
+    // so the first call filters every variable.
+    S.table_start  = allocate<int>(constraints.count, -1, stack);
+    int table_size = 0;
+    for (int c = 0; c < constraints.count; ++c) {
+        auto& constraint = constraints[c];
+        if (constraint.type != Constraint::TABLE) continue;
+        int n = constraint.scope.count;
+        int w = num_words(constraint.constants.count / n);
+        S.table_start[c] = table_size;
+        table_size += 1 + n + 2 * w;
+    }
+    S.tables = allocate<uint64_t>(table_size, uint64_t(0), stack);
+    for (int c = 0; c < constraints.count; ++c) {
+        auto& constraint = constraints[c];
+        if (constraint.type != Constraint::TABLE) continue;
+        int  n          = constraint.scope.count;
+        int  num_tuples = constraint.constants.count / n;
+        int  w          = num_words(num_tuples);
+        auto data       = S.tables.data + S.table_start[c];
+        auto words      = data + 1 + n;
+        auto index      = words + w;
+        data[0]         = w;
+        for (int k = 0; k < w; ++k) index[k] = k;
+        for (int t = 0; t < num_tuples; ++t) words[t / 64] |= bit(t);
+        for (int i = 0; i < n; ++i)
+            data[1 + i] = 64 * domains[constraint.scope[i]].num_words + 1;
+    }
+
+    S.weights          = allocate<int>(constraints.count, 1, stack);
+    S.weighted_degrees = allocate<int>(domains.count, stack);
+    for (int v = 0; v < domains.count; ++v)
+        S.weighted_degrees[v] = constraints_of(csp, v).count;
+    S.heap          = allocate<int>(domains.count, stack);
+    S.heap.count    = 0;
+    S.heap_position = allocate<int>(domains.count, -1, stack);
+    for (int v = 0; v < domains.count; ++v) heap_update(S, v);
+
+    int n = domains.count;
+    if (options.phase_saving) S.phases = allocate<int>(n, INT_MIN, stack);
+
+    if (options.trace) {
+        S.trace_events       = allocate<trace_event>(TRACE_BLOCK_SIZE, stack);
+        S.trace_events.count = 0;
+        S.trace_thread       = trace_thread(options.trace);
+    }
+#if CSP_PROFILE
+    S.profile.wipeouts = allocate<int>(constraints.count, 0, stack);
+#endif
+
+    if (options.learn_nogoods) {
+        S.marks     = allocate<int>(n, 0, stack);
+        S.conflict  = allocate<uint64_t>(num_words(n + 2), uint64_t(0), stack);
+        S.decisions = allocate<assignment>(n + 2, stack);
+
+        auto& N       = S.nogoods;
+        int   max     = options.max_nogoods;
+        N.max_size    = options.max_nogood_size;
+        N.decisions   = allocate<assignment>(max * N.max_size, stack);
+        N.sizes       = allocate<int>(max, stack);
+        N.sizes.count = 0;
+        N.activity    = allocate<float>(max, stack);
+        N.next_watch  = allocate<int>(2 * max, -1, stack);
+        N.first_watch = allocate<int>(n, -1, stack);
+    }
+    return S;
+}
+
+// Forget the failures counted by dom/wdeg.
+inline void reset_weights(search_state& S) {
+    fill(S.weights, 1);
+    for (int v = 0; v < S.domains.count; ++v) {
+        S.weighted_degrees[v] = constraints_of(*S.csp, v).count;
+        heap_update(S, v);
+    }
+}
+
+// Term i of the Luby sequence 1, 1, 2, 1, 1, 2, 4, 1..., from i = 0.
+inline int luby(int i) {
+    int size = 1, power = 0;
+    while (size < i + 1) {
+        size = 2 * size + 1;
+        power += 1;
+    }
+    while (size - 1 != i) {
+        size = (size - 1) / 2;
+        power -= 1;
+        i    = i % size;
+    }
+    return 1 << power;
+}
+
+inline void save_level(search_state& S) { S.levels.push_back(S.trail.count); }
+
+// Undo all the changes recorded after the first entries of the trail.
+inline void restore_trail(search_state& S, int start) {
+    while (S.trail.count > start) {
+        auto& entry = S.trail.back();
+        *entry.word = entry.value;
+        S.trail.count -= 1;
+        if (entry.variable != -1) heap_update(S, entry.variable);
+    }
+    if (S.nogoods.checked > S.trail.count) S.nogoods.checked = S.trail.count;
+}
+
+// Undo all the changes made after the last save point.
+inline void restore_level(search_state& S) {
+    int start = S.levels.back();
+    S.levels.count -= 1;
+    restore_trail(S, start);
+}
+
+// Add a constraint to the propagation queue.
+inline void schedule(search_state& S, int constraint) {
+    if (S.queued[constraint]) return;
+    S.queued[constraint] = true;
+    int capacity         = S.queued.count;
+    S.queue.data[(S.queue_start + S.queue.count) % capacity] = constraint;
+    S.queue.count += 1;
+}
+
+inline void schedule_all(search_state& S) {
+    for (int c = 0; c < S.queued.count; ++c) schedule(S, c);
+}
+
+// Remove the next constraint from the propagation queue.
+inline int next_scheduled(search_state& S) {
+    int constraint       = S.queue.data[S.queue_start];
+    S.queue_start        = (S.queue_start + 1) % S.queued.count;
+    S.queued[constraint] = false;
+    S.queue.count -= 1;
+    return constraint;
+}
+
+inline void clear_schedule(search_state& S) {
+    while (S.queue.count > 0) next_scheduled(S);
+}
+
+// Queue the constraints that watch the events of a change to the domain of
+// a variable, given its previous bounds.
+inline void notify(search_state& S, int variable, int old_min, int old_max) {
+    auto& d = S.domains[variable];
+    heap_update(S, variable);
+    if (is_empty(d)) return;  // The propagator is going to fail anyway.
+
+    int events = DOMAIN_CHANGED;
+    int min    = d.min();
+    int max    = d.max();
+    if (min != old_min or max != old_max) events |= BOUNDS_CHANGED;
+    if (min == max) events |= VALUE_FIXED;
+
+    for (int c : constraints_of(*S.csp, variable)) {
+        if (c == S.propagating and S.idempotent[c]) continue;
+        if (S.watch_events[c] & events) schedule(S, c);
+    }
+}
+
+// Change a word of propagator state, recording it on the trail.
+inline void set_trailed(search_state& S, uint64_t& word, uint64_t value) {
+    if (word == value) return;
+    S.trail.push_back({-1, -1, &word, word});
+    word = value;
+}
+
+// Record the decision of the last level, the reason of the changes it makes.
+inline void add_decision(search_state& S, int variable, int value) {
+    S.decisions[S.levels.count] = {variable, value};
+}
+
+inline void set_word(search_state& S, int variable, int i, uint64_t value) {
+    auto& word   = S.domains[variable].words()[i];
+    int   reason = S.propagating == -1 ? S.reason : S.propagating;
+    if (word == value) return;
+    S.trail.push_back({variable, reason, &word, word});
+#if CSP_PROFILE
+    if (S.propagating != -1) {
+        int type = S.csp->constraints[S.propagating].type;
+        S.profile.removals[type] += popcount(word & ~value);
+    }
+#endif
+    word = value;
+}
+
+// Remove a value from the domain of a variable. Returns true if the domain
+// changed.
+inline bool remove_value(search_state& S, int variable, int value) {
+    auto& d = S.domains[variable];
+    if (not d.contains(value)) return false;
+    int min = d.min(), max = d.max();
+    int i   = value - d.offset;
+    set_word(S, variable, i / 64, d.words()[i / 64] & ~bit(i));
+    notify(S, variable, min, max);
+    return true;
+}
+
+// Reduce the domain of a variable to a single value. The domain is left empty
+// if it does not contain the value.
+inline void assign_value(search_state& S, int variable, int value) {
+    auto& d = S.domains[variable];
+    if (is_empty(d)) return;
+    int min = d.min(), max = d.max();
+    int i   = value - d.offset;
+    for (int k = 0; k < d.num_words; ++k) {
+        auto mask = (k == i / 64 and i >= 0) ? bit(i) : uint64_t(0);
+        set_word(S, variable, k, d.words()[k] & mask);
+    }
+    if (min != max) notify(S, variable, min, max);
+}
+
+// Remove the values outside [min, max]. Returns true if the domain changed.
+inline bool restrict_bounds(search_state& S, int variable, int min, int max) {
+    auto& d = S.domains[variable];
+    if (is_empty(d)) return false;
+    int old_min = d.min(), old_max = d.max();
+    if (min <= old_min and max >= old_max) return false;
+    for (int k = 0; k < d.num_words; ++k) {
+        // Bits of word k in [min - offset, max - offset].
+        int  lo   = min - d.offset - 64 * k;
+        int  hi   = max - d.offset - 64 * k;
+        auto mask = ~uint64_t(0);
+        if (lo > 63 or hi < 0 or lo > hi) {
+            mask = 0;
+        } else {
+            if (lo > 0) mask &= ~uint64_t(0) << lo;
+            if (hi < 63) mask &= ~uint64_t(0) >> (63 - hi);
+        }
+        set_word(S, variable, k, d.words()[k] & mask);
+    }
+    notify(S, variable, old_min, old_max);
+    return true;
+}
+
+// Keep only the values that are also in mask. Returns true if the domain
+// changed.
+inline bool restrict_domain(search_state& S, int variable, const Domain& mask) {
+    auto& d = S.domains[variable];
+    assert(d.offset == mask.offset and d.num_words == mask.num_words);
+    if (is_empty(d)) return false;
+    int  min     = d.min(), max = d.max();
+    bool changed = false;
+    for (int k = 0; k < d.num_words; ++k) {
+        auto word = d.words()[k];
+        if ((word & ~mask.words()[k]) == 0) continue;
+        set_word(S, variable, k, word & mask.words()[k]);
+        changed = true;
+    }
+    if (changed) notify(S, variable, min, max);
+    return changed;
+}
+
 // Printing functions.
 inline void print_array(const array<int>& d) {
     printf("[");
@@ -86,11 +1279,18 @@ inline void print_array(const array<int>& d) {
     printf("%d]\n", d.back());
 }
 
+inline void print_domain(const Domain& d) {
+    printf("[");
+    int i = 0;
+    for (int v : d) printf(i++ ? ", %d" : "%d", v);
+    printf("]\n");
+}
+
 inline void print_domains(const array<Domain>& domains) {
     printf("\ndomains:\n");
     for (int i = 0; i < domains.count; ++i) {
         printf("%d: ", i);
-        print_array(domains[i]);
+        print_domain(domains[i]);
     }
 }
 
@@ -98,57 +1298,126 @@ inline void print_state(const array<Domain>& D, int depth = 0) {
     for (int i = 0; i < D.size(); ++i) {
         for (int k = 0; k < depth; ++k) printf("-");
         printf(" %d = ", i);
-        print_array(D[i]);
+        print_domain(D[i]);
     }
 }
 
+// Print the name of a constraint followed by its scope, like diag+(0, 3).
+inline void print_constraint(const Constraint& c, FILE* file = stdout) {
+    fprintf(file, "%s(", c.name);
+    for (int i = 0; i < c.scope.count; ++i)
+        fprintf(file, i ? ", %d" : "%d", c.scope[i]);
+    fprintf(file, ")");
+}
+
 inline void print_constraints(const array<Constraint>& constraints) {
     for (auto& c : constraints) {
-        write(c.name);
-        // print_array(c.scope);
-        write("");
+        print_constraint(c);
+        printf("\n\n");
     }
     write("\n");
 }
 
-inline Assignment make_assignment(const array<Domain>& D) {
-    auto A  = allocate<assignment>(D.count);
+inline Assignment make_assignment(
+    const array<Domain>& D, stack_allocator& stack = default_allocator()) {
+    auto A  = allocate<assignment>(D.count, stack);
     A.count = 0;
     for (int i = 0; i < D.size(); i++) {
-        if (D[i].size() == 1) A.push_back({i, D[i][0]});
+        if (D[i].size() == 1) A.push_back({i, D[i].value()});
     }
     return A;
 }
 
 inline void apply_assignment(array<Domain>& D, const Assignment& A) {
-    for (auto& a : A) D[a.variable] = {a.value};
+    for (auto& a : A) fix(D[a.variable], a.value);
+}
+
+template <typename Cost>
+inline Objective make_objective(const CSP& csp, const array<int>& variables,
+                                const Cost& cost, stack_allocator& stack) {
+    auto objective      = Objective{};
+    objective.variables = copy(variables, stack);
+    objective.costs     = allocate<array<int>>(variables.count, stack);
+    for (int i = 0; i < variables.count; ++i) {
+        auto& d            = csp.domains[variables[i]];
+        objective.costs[i] = allocate<int>(64 * d.num_words, stack);
+        for (int k = 0; k < objective.costs[i].count; ++k)
+            objective.costs[i][k] = cost(variables[i], d.offset + k);
+    }
+    return objective;
+}
+
+inline Objective weighted_sum(const CSP& csp, const array<int>& variables,
+                              const array<int>& weights,
+                              stack_allocator&  stack) {
+    auto zero      = [](int, int) { return 0; };
+    auto objective = make_objective(csp, variables, zero, stack);
+    for (int i = 0; i < variables.count; ++i) {
+        int offset = csp.domains[variables[i]].offset;
+        for (int k = 0; k < objective.costs[i].count; ++k)
+            objective.costs[i][k] = weights[i] * (offset + k);
+    }
+    return objective;
 }
 
 inline void print_stats(const search_stats& stats) {
     printf("\nSearch statistics:\n");
-    printf("   num_backtracks = %d\n", stats.backtracks);
-    printf("   num_expansions = %d\n\n", stats.expansions);
+    printf("   num_backtracks = %lld\n", stats.backtracks);
+    if (stats.restarts > 0)
+        printf("   num_restarts   = %lld\n", stats.restarts);
+    printf("   num_expansions = %lld\n", stats.expansions);
+    printf("   num_propagations = %lld\n\n", stats.propagations);
+
+#if CSP_PROFILE
+    auto& P       = stats.profile;
+    auto  types   = {"all_different", "binary", "nary", "unary", "table"};
+    int   type    = 0;
+    auto  percent = [&](uint64_t cycles) {
+        auto total = P.heuristic_cycles + P.propagate_cycles + P.check_cycles;
+        return total == 0 ? 0.0 : 100.0 * cycles / total;
+    };
+    printf("Search profile:\n");
+    printf("   %-14s %14s %14s\n", "", "propagations", "removals");
+    for (auto name : types) {
+        if (P.propagations[type] > 0)
+            printf("   %-14s %14lld %14lld\n", name, P.propagations[type],
+                   P.removals[type]);
+        type += 1;
+    }
+    long long wipeouts = 0;
+    for (int w : P.wipeouts) wipeouts += w;
+    printf("   wipeouts       = %lld\n", wipeouts);
+    printf("   max_depth      = %d\n", P.max_depth);
+    printf("   heuristic      = %.3g cycles (%.1f%%)\n",
+           (double)P.heuristic_cycles, percent(P.heuristic_cycles));
+    printf("   propagation    = %.3g cycles (%.1f%%)\n",
+           (double)P.propagate_cycles, percent(P.propagate_cycles));
+    printf("   leaf checks    = %.3g cycles (%.1f%%)\n",
+           (double)P.check_cycles, percent(P.check_cycles));
+    printf("   peak_memory    = %zu bytes\n\n", stats.peak_memory);
+#endif
 }
 
+// The constraints that failed most often, with CSP_PROFILE.
+void print_wipeouts(const CSP& csp, const search_stats& stats, int count = 10);
+
 inline Constraint::Constraint(enum type t, const array<int>& vars,
-                              const string& s) {
+                              const char* s) {
     type  = t;
     scope = copy(vars);
-    name  = s;
-    name += "(";
-
-    for (int i = 0; i < scope.size() - 1; ++i) {
-        name += to_string(scope[i]);
-        name += ", ";
-    }
-    name += to_string(scope.back());
-    name += ")";
+    name  = intern_name(s);
 }
 
-// Constraint all_different
-inline Constraint all_different(const array<int>& scope,
-                                const string&     name = "all_different") {
-    auto result = Constraint(Constraint::ALL_DIFFERENT, scope, name);
+// Constraint all_different. With DOMAIN_CONSISTENCY it removes every value
+// that does not belong to a maximum matching between variables and values
+// (Regin's algorithm). With BOUNDS_CONSISTENCY it only tightens the bounds of
+// the domains using Hall intervals, in O(n log n), which suits large scopes
+// over wide domains. Otherwise it only removes the values of fixed variables.
+inline Constraint all_different(
+    const array<int>& scope, const char* name = "all_different",
+    enum Constraint::consistency consistency = Constraint::FORWARD_CHECKING) {
+    auto result        = Constraint(Constraint::ALL_DIFFERENT, scope, name);
+    result.consistency = consistency;
     return result;
 }
 
@@ -160,25 +1429,21 @@ inline bool eval_all_different(const Constraint&    constraint,
         for (int k = i + 1; k < constraint.scope.size(); ++k) {
             int w = constraint.scope[k];
             if (D[w].size() == 1)
-                if (D[v][0] == D[w][0]) return false;
+                if (D[v].value() == D[w].value()) return false;
         }
     }
     return true;
 }
 
 inline bool propagate_all_different(const Constraint& constraint,
-                                    array<Domain>&    D) {
+                                    search_state&     S) {
+    auto& D = S.domains;
     for (int v : constraint.scope) {
-        if (D[v].count != 1) continue;
+        if (D[v].size() != 1) continue;
+        int value = D[v].value();
         for (int w : constraint.scope) {
             if (w == v) continue;
-            for (int i = 0; i < D[w].count; ++i) {
-                if (D[w][i] == D[v][0]) {
-                    D[w].remove(i);
-                    if (D[w].count == 0) return false;
-                    break;
-                }
-            }
+            if (remove_value(S, w, value) and is_empty(D[w])) return false;
         }
     }
     return true;
@@ -187,9 +1452,13 @@ inline bool propagate_all_different(const Constraint& constraint,
 inline bool eval_unary(const Constraint&    constraint,
                        const array<Domain>& domains) {
     int x = constraint.scope[0];
-    if (domains[x].count == 1) {
-        stack_frame();
-        auto value = allocate<int>({domains[x][0]});
+    if (domains[x].size() == 1 and constraint.supports.count > 0) {
+        int i = domains[x].value() - domains[x].offset;
+        return (constraint.supports[i / 64] & bit(i)) != 0;
+    }
+    if (domains[x].size() == 1) {
+        int  v[1]  = {domains[x].value()};
+        auto value = array<int>(v, 1);
         if (not constraint.eval_custom(constraint, value)) return false;
     }
     return true;
@@ -199,77 +1468,306 @@ inline bool eval_binary(const Constraint&    constraint,
                         const array<Domain>& domains) {
     int x = constraint.scope[0];
     int y = constraint.scope[1];
-    if (domains[x].count == 1 and domains[y].count == 1) {
-        stack_frame();
-        auto xy = allocate({domains[x][0], domains[y][0]});
+    if (domains[x].size() == 1 and domains[y].size() == 1 and
+        constraint.supports.count > 0) {
+        int  i   = domains[x].value() - domains[x].offset;
+        int  k   = domains[y].value() - domains[y].offset;
+        auto row = constraint.supports.data + i * domains[y].num_words;
+        return (row[k / 64] & bit(k)) != 0;
+    }
+    if (domains[x].size() == 1 and domains[y].size() == 1) {
+        int  v[2] = {domains[x].value(), domains[y].value()};
+        auto xy   = array<int>(v, 2);
         if (not constraint.eval_custom(constraint, xy)) return false;
     }
     return true;
 }
 
-inline bool propagate_unary(const Constraint& constraint, array<Domain>& D) {
-    stack_frame();
-    int x = constraint.scope[0];
+inline bool propagate_unary(const Constraint& constraint, search_state& S) {
+    stack_frame_on(*S.stack);
+    auto& D = S.domains;
+    int   x = constraint.scope[0];
 
-    auto domain_new  = allocate<int>(D[x].count);
-    domain_new.count = 0;
+    if (constraint.supports.count > 0) {
+        auto mask = Domain{D[x].offset, D[x].num_words, 0, nullptr};
+        if (mask.num_words == 1) mask.bits = constraint.supports[0];
+        else mask.data = constraint.supports.data;
+        restrict_domain(S, x, mask);
+        return not is_empty(D[x]);
+    }
+
+    auto domain_new = make_empty_like(D[x], *S.stack);
+    int  v[1]   = {0};
+    auto values = array<int>(v, 1);
     for (auto value : D[x]) {
-        stack_frame();
-        auto v = allocate({value});
-        if (constraint.eval_custom(constraint, v)) {
-            domain_new.push_back(value);
+        v[0] = value;
+        if (constraint.eval_custom(constraint, values)) {
+            insert(domain_new, value);
         }
     }
-    if (domain_new.count == 0) return false;
-    copy_to(domain_new, D[x]);
+    if (is_empty(domain_new)) return false;
+    restrict_domain(S, x, domain_new);
     return true;
 }
 
-inline bool propagate_binary(const Constraint& constraint, array<Domain>& D) {
-    stack_frame();
-    int x0 = constraint.scope[0];
-    int x1 = constraint.scope[1];
-    // Domain d0, d1;
-    auto d0  = allocate<int>(D[x0].size() * D[x1].size());
-    auto d1  = allocate<int>(D[x0].size() * D[x1].size());
-    d0.count = 0;
-    d1.count = 0;
-    // std::set d0, d1; // @Try with std::set, code will be simpler.
-    for (int v0 : D[x0]) {
+// Remove the values of x that have no support in the domain of y, according
+// to check(value of x, value of y). The last support found for each value is
+// kept in residues and checked first (AC-3rm).
+template <typename Check>
+inline bool revise_binary(search_state& S, int x, int y, int* residues,
+                          const Check& check) {
+    auto& dx = S.domains[x];
+    auto& dy = S.domains[y];
+    for (int a : dx) {
+        int& residue = residues[a - dx.offset];
+        if (residue != NO_SUPPORT and dy.contains(residue)) continue;
+
         bool found = false;
-        for (int v1 : D[x1]) {
-            stack_frame();
-            auto xy = allocate({v0, v1});
-            if (constraint.eval_custom(constraint, xy)) {
-                if (not contains(d1, v1)) d1.push_back(v1);
-                found = true;
+        for (int b : dy) {
+            if (check(a, b)) {
+                residue = b;
+                found   = true;
+                break;
             }
         }
-        if (found) d0.push_back(v0);
+        if (not found) remove_value(S, x, a);
     }
-    if (d0.size() == 0) return false;
-    if (d1.size() == 0) return false;
-    copy_to(d0, D[x0]);
-    copy_to(d1, D[x1]);
+    return not is_empty(dx);
+}
+
+// Like revise_binary(), with the supports of each value of x tabulated in
+// rows of bits in the layout of the domain of y.
+inline bool revise_binary_table(search_state& S, int x, int y,
+                                int* residues, const uint64_t* rows) {
+    auto& dx    = S.domains[x];
+    auto& dy    = S.domains[y];
+    auto  words = dy.words();
+    int   n     = dy.num_words;
+    for (int a : dx) {
+        int& residue = residues[a - dx.offset];
+        if (residue != NO_SUPPORT and dy.contains(residue)) continue;
+
+        auto row = rows + (a - dx.offset) * n;
+        int  k   = 0;
+        while (k < n and (row[k] & words[k]) == 0) k++;
+        if (k == n) {
+            remove_value(S, x, a);
+        } else {
+            residue = dy.offset + 64 * k +
+                      count_trailing_zeros(row[k] & words[k]);
+        }
+    }
+    return not is_empty(dx);
+}
+
+// Revise both variables of a binary constraint with check(value of x0,
+// value of x1).
+template <typename Check>
+inline bool revise_binary(const Constraint& constraint, search_state& S,
+                          const Check& check) {
+    int  x0       = constraint.scope[0];
+    int  x1       = constraint.scope[1];
+    int* residues = S.residues.data + S.residue_start[S.propagating];
+    int  width    = 64 * S.domains[x0].num_words;
+    auto check_reverse = [&](int v1, int v0) { return check(v0, v1); };
+
+    if (not revise_binary(S, x0, x1, residues, check)) return false;
+    if (not revise_binary(S, x1, x0, residues + width, check_reverse))
+        return false;
     return true;
 }
 
+// Arc consistency with residual supports. The constraint is queued again by
+// its own removals, so the queue makes it reach a fixpoint.
+inline bool propagate_binary(const Constraint& constraint, search_state& S) {
+    if (constraint.supports.count > 0) {
+        // Rows of x0 first, then the ones of x1.
+        int  x0       = constraint.scope[0];
+        int  x1       = constraint.scope[1];
+        int* residues = S.residues.data + S.residue_start[S.propagating];
+        int  width    = 64 * S.domains[x0].num_words;
+        auto rows     = constraint.supports.data;
+        if (not revise_binary_table(S, x0, x1, residues, rows)) return false;
+        rows += width * S.domains[x1].num_words;
+        return revise_binary_table(S, x1, x0, residues + width, rows);
+    }
+
+    int  v[2]   = {0, 0};
+    auto values = array<int>(v, 2);
+    auto check  = [&](int v0, int v1) {
+        v[0] = v0;
+        v[1] = v1;
+        return constraint.eval_custom(constraint, values);
+    };
+    return revise_binary(constraint, S, check);
+}
+
 inline bool eval_nary(const Constraint&    constraint,
-                      const array<Domain>& domains) {
+                      const array<Domain>& domains,
+                      stack_allocator&     stack = default_allocator()) {
     for (auto var : constraint.scope)
-        if (domains[var].count != 1) return true;
+        if (domains[var].size() != 1) return true;
 
-    stack_frame();
-    auto values = allocate<int>(constraint.scope.count);
+    stack_frame_on(stack);
+    auto values = allocate<int>(constraint.scope.count, stack);
     for (int i = 0; i < constraint.scope.count; ++i) {
-        values[i] = domains[constraint.scope[i]][0];
+        values[i] = domains[constraint.scope[i]].value();
     }
 
     return constraint.eval_custom(constraint, values);
 }
 
-inline bool propagate_nary(const Constraint& constraint, array<Domain>& D) {
-    return true;
+inline bool propagate_nary(const Constraint& constraint, search_state& S) {
+    // No filtering, just check the constraint once all the scope is fixed.
+    return eval_nary(constraint, S.domains, *S.stack);
+}
+
+// Evaluation and propagation of a family of constraints that share the same
+// predicate, instantiated for it.
+struct constraint_kernels {
+    bool (*eval)(const Constraint&, const array<Domain>&, stack_allocator&);
+    bool (*propagate)(const Constraint&, search_state&);
+};
+
+// Constraints whose predicate is a functor type Pred, called as
+// Pred{}(constraint, x) for unary constraints, Pred{}(constraint, x, y) for
+// binary ones and Pred{}(constraint, values) for nary ones. Evaluation and
+// propagation are instantiated for each predicate, which is inlined in their
+// loops instead of being called through eval_custom. eval_custom is still
+// set, so the constraints can be tabulated by compile_tables().
+template <typename Pred>
+inline bool eval_unary_kernel(const Constraint&    constraint,
+                              const array<Domain>& domains,
+                              stack_allocator&) {
+    auto& d = domains[constraint.scope[0]];
+    return d.size() != 1 or Pred{}(constraint, d.value());
+}
+
+template <typename Pred>
+inline bool propagate_unary_kernel(const Constraint& constraint,
+                                   search_state&     S) {
+    stack_frame_on(*S.stack);
+    int  x    = constraint.scope[0];
+    auto mask = make_empty_like(S.domains[x], *S.stack);
+    for (int v : S.domains[x])
+        if (Pred{}(constraint, v)) insert(mask, v);
+    restrict_domain(S, x, mask);
+    return not is_empty(S.domains[x]);
+}
+
+template <typename Pred>
+inline bool eval_binary_kernel(const Constraint&    constraint,
+                               const array<Domain>& domains,
+                               stack_allocator&) {
+    auto& dx = domains[constraint.scope[0]];
+    auto& dy = domains[constraint.scope[1]];
+    if (dx.size() != 1 or dy.size() != 1) return true;
+    return Pred{}(constraint, dx.value(), dy.value());
+}
+
+template <typename Pred>
+inline bool propagate_binary_kernel(const Constraint& constraint,
+                                    search_state&     S) {
+    auto pred  = Pred{};
+    auto check = [&](int v0, int v1) { return pred(constraint, v0, v1); };
+    return revise_binary(constraint, S, check);
+}
+
+template <typename Pred>
+inline bool eval_nary_kernel(const Constraint&    constraint,
+                             const array<Domain>& domains,
+                             stack_allocator&     stack) {
+    for (auto var : constraint.scope)
+        if (domains[var].size() != 1) return true;
+
+    stack_frame_on(stack);
+    auto values = allocate<int>(constraint.scope.count, stack);
+    for (int i = 0; i < constraint.scope.count; ++i)
+        values[i] = domains[constraint.scope[i]].value();
+    return Pred{}(constraint, values);
+}
+
+template <typename Pred>
+inline bool propagate_nary_kernel(const Constraint& constraint,
+                                  search_state&     S) {
+    return eval_nary_kernel<Pred>(constraint, S.domains, *S.stack);
+}
+
+template <typename Pred>
+inline bool call_unary(const Constraint& constraint, const array<int>& v) {
+    return Pred{}(constraint, v[0]);
+}
+
+template <typename Pred>
+inline bool call_binary(const Constraint& constraint, const array<int>& v) {
+    return Pred{}(constraint, v[0], v[1]);
+}
+
+template <typename Pred>
+inline bool call_nary(const Constraint& constraint, const array<int>& v) {
+    return Pred{}(constraint, v);
+}
+
+template <typename Pred>
+inline Constraint unary_constraint(int x, const char* name = "unary") {
+    static const auto kernels = constraint_kernels{
+        eval_unary_kernel<Pred>, propagate_unary_kernel<Pred>};
+    int  v[1]          = {x};
+    auto result        = Constraint(Constraint::UNARY, {v, 1}, name);
+    result.eval_custom = call_unary<Pred>;
+    result.kernels     = &kernels;
+    return result;
+}
+
+template <typename Pred>
+inline Constraint binary_constraint(int x, int y,
+                                    const char* name = "binary") {
+    static const auto kernels = constraint_kernels{
+        eval_binary_kernel<Pred>, propagate_binary_kernel<Pred>};
+    int  v[2]          = {x, y};
+    auto result        = Constraint(Constraint::BINARY, {v, 2}, name);
+    result.eval_custom = call_binary<Pred>;
+    result.kernels     = &kernels;
+    return result;
+}
+
+template <typename Pred>
+inline Constraint nary_constraint(const array<int>& scope,
+                                  const char*       name = "nary") {
+    static const auto kernels = constraint_kernels{
+        eval_nary_kernel<Pred>, propagate_nary_kernel<Pred>};
+    auto result        = Constraint(Constraint::NARY, scope, name);
+    result.eval_custom = call_nary<Pred>;
+    result.kernels     = &kernels;
+    return result;
+}
+
+// Constraint table. The allowed tuples are given one after the other, each
+// with a value for every variable of the scope. It is propagated to
+// generalized arc consistency with the Compact-Table algorithm: bitwise
+// operations between the valid tuples and the tuples supporting each value.
+inline Constraint table(const array<int>& scope, const array<int>& tuples,
+                        const char* name = "table") {
+    assert(tuples.count % scope.count == 0);
+    auto result      = Constraint(Constraint::TABLE, scope, name);
+    result.constants = copy(tuples);
+    return result;
+}
+
+inline bool eval_table(const Constraint&    constraint,
+                       const array<Domain>& domains) {
+    auto& scope = constraint.scope;
+    for (auto var : scope)
+        if (domains[var].size() != 1) return true;
+
+    auto& tuples = constraint.constants;
+    for (int t = 0; t < tuples.count; t += scope.count) {
+        int i = 0;
+        while (i < scope.count and tuples[t + i] == domains[scope[i]].value())
+            i++;
+        if (i == scope.count) return true;
+    }
+    return false;
 }
 
 // Constraint equal(int x, int y, const string& name = "equal") {
@@ -349,7 +1847,11 @@ inline bool propagate_nary(const Constraint& constraint, array<Domain>& D) {
 //     return true;
 // }
 
-inline bool eval(const Constraint& constraint, const array<Domain>& domains) {
+inline bool eval(const Constraint& constraint, const array<Domain>& domains,
+                 stack_allocator& stack) {
+    // Tabulated predicates are looked up in their tables instead.
+    if (constraint.kernels and constraint.supports.count == 0)
+        return constraint.kernels->eval(constraint, domains, stack);
     auto type = constraint.type;
     // if (type == RELATION)assert(0);  // return eval_relation(constraint,
     // domains);
@@ -357,24 +1859,34 @@ inline bool eval(const Constraint& constraint, const array<Domain>& domains) {
         return eval_all_different(constraint, domains);
     // if (type == Constraint::EQUAL) return eval_equal(constraint, domains);
     if (type == Constraint::BINARY) return eval_binary(constraint, domains);
-    if (type == Constraint::NARY) return eval_nary(constraint, domains);
+    if (type == Constraint::NARY) return eval_nary(constraint, domains, stack);
     if (type == Constraint::UNARY) return eval_unary(constraint, domains);
+    if (type == Constraint::TABLE) return eval_table(constraint, domains);
     // if (type == Constraint::CUSTOM) return eval_custom(constraint, domains);
     return false;
 }
 
-inline bool propagate(const Constraint& constraint, array<Domain>& domains) {
-    // if (type == RELATION) return propagate_relation(constraint, domains);
-    if (constraint.type == Constraint::ALL_DIFFERENT)
-        return propagate_all_different(constraint, domains);
+inline bool propagate(const Constraint& constraint, search_state& state) {
+    if (constraint.kernels and constraint.supports.count == 0)
+        return constraint.kernels->propagate(constraint, state);
+    // if (type == RELATION) return propagate_relation(constraint, state);
+    if (constraint.type == Constraint::ALL_DIFFERENT) {
+        if (constraint.consistency == Constraint::DOMAIN_CONSISTENCY)
+            return propagate_all_different_matching(constraint, state);
+        if (constraint.consistency == Constraint::BOUNDS_CONSISTENCY)
+            return propagate_all_different_bounds(constraint, state);
+        return propagate_all_different(constraint, state);
+    }
     // if (type == Constraint::EQUAL) return propagate_equal(constraint,
     // domains);
     if (constraint.type == Constraint::BINARY)
-        return propagate_binary(constraint, domains);
+        return propagate_binary(constraint, state);
     if (constraint.type == Constraint::NARY)
-        return propagate_nary(constraint, domains);
+        return propagate_nary(constraint, state);
     if (constraint.type == Constraint::UNARY)
-        return propagate_unary(constraint, domains);
+        return propagate_unary(constraint, state);
+    if (constraint.type == Constraint::TABLE)
+        return propagate_table(constraint, state);
     return false;
 }
 
@@ -386,7 +1898,9 @@ inline void print_unsatisfied(const array<Domain>&     D,
     for (int i = 0; i < C.size(); ++i) {
         if (not eval(C[i], D)) {
             found = true;
-            printf("\n%d: %s\n", i, (const char*)C[i].name);
+            printf("\n%d: ", i);
+            print_constraint(C[i]);
+            printf("\n");
         }
     }
     if (not found) printf("nothing\n");
@@ -0,0 +1,64 @@
+#pragma once
+#include <stdlib.h>
+
+#include "../csp.h"
+
+// Queens in rows i and j are not on the same diagonal, with j - i in the
+// constants.
+struct not_on_diagonal {
+    bool operator()(const Constraint& c, int x, int y) const {
+        return abs(x - y) != abs(c.constants[0]);
+    }
+};
+
+inline CSP make_nqueens(int N = 8) {
+    auto domains = allocate<Domain>(N);
+    for (auto& d : domains) d = make_domain(0, N);
+
+    auto num_constraints = N * N;
+    CSP  csp             = make_csp("N-Queens", domains, num_constraints);
+
+    // constraint: One queen per column.
+    auto one_per_column = all_different(make_range(N), "one_per_column");
+    csp.constraints.push_back(one_per_column);
+
+    // constraint: No diagonal threats.
+    for (int i = 0; i < N - 1; ++i) {
+        for (int j = i + 1; j < N; ++j) {
+            auto diag = binary_constraint<not_on_diagonal>(i, j, "diag+");
+            diag.constants = allocate({j - i});
+            csp.constraints.push_back(diag);
+        }
+    }
+    finalize_csp(csp);
+    return csp;
+}
+
+inline void print_nqueens(int N, const Assignment& A) {
+    for (int i = 0; i < N; i++) {
+        for (int k = 0; k < N; k++) {
+            if (k == A[i].value)
+                printf(" Q");  // There's a queen.
+            else
+                printf(" -");  // Empty cell.
+        }
+        printf("\n");
+    }
+    printf("\n");
+}
+
+inline void print_nqueens(int N, const array<Domain>& D) {
+    for (int i = 0; i < N; i++) {
+        for (int k = 0; k < N; k++) {
+            if (contains(D[i], k))
+                if (D[i].size() == 1)
+                    printf(" Q");  // There's a queen.
+                else
+                    printf(" -");  // There's a queen.
+            else
+                printf("  ");  // Empty cell.
+        }
+        printf("\n");
+    }
+    printf("\n");
+}
@@ -1,79 +1,92 @@
-#include "../csp.h"
+#include <stdlib.h>
+#include <string.h>
 
-CSP make_sudoku(int N) {
-    auto domains = allocate<array<int>>(N * N * N * N);
-    for (auto& d : domains) d = make_range(1, N * N + 1);
+#include <chrono>
 
-    auto num_constraints = 3 * N * N;
-    CSP  sudoku          = make_csp("Sudoku", domains, num_constraints);
+#include "sudoku.h"
 
-    auto row   = allocate<int>(N * N);
-    auto col   = allocate<int>(N * N);
-    auto block = allocate<int>(N * N);
-    for (int k = 0; k < N * N; ++k) {
-        int block_start = (k / N) * (N * N * N) + (k % N) * N;
-        for (int i = 0; i < N * N; ++i) {
-            row[i]   = k * N * N + i;
-            col[i]   = i * N * N + k;
-            block[i] = block_start + (i / N) * N * N + i % N;
-        }
-        sudoku.constraints.push_back(all_different(row, "row_diff"));
-        sudoku.constraints.push_back(all_different(col, "col_diff"));
-        sudoku.constraints.push_back(all_different(block, "block_diff"));
-    }
-
-    return sudoku;
-}
+struct corpus_batch {
+    sudoku_corpus*   corpus;
+    buffered_writer* writer;
+    long long        solved = 0;
+};
 
-array<Domain> parse_sudoku(const string& s, int N) {
-    auto A = allocate<array<int>>(N * N * N * N);
-    for (int i = 0; i < N * N * N * N; i++) {
-        int idx = i * 2 + 1;
-        if (s[idx] != '-')
-            A[i] = allocate({s[idx] - '0'});
-        else
-            A[i] = make_range(1, N * N + 1);
+// Solve every puzzle of a corpus with solve_batch(), writing the solutions in
+// the order of the puzzles.
+static int solve_corpus(const char* filename, int num_threads,
+                        const char* output) {
+    auto start  = std::chrono::steady_clock::now();
+    auto corpus = sudoku_corpus(filename);
+    if (not index_sudoku_corpus(corpus, num_threads)) {
+        fprintf(stderr, "Cannot read sudokus from %s\n", filename);
+        return 1;
+    }
+    auto file = output ? fopen(output, "wb") : stdout;
+    if (not file) {
+        fprintf(stderr, "Cannot create %s\n", output);
+        return 1;
     }
 
-    return A;
-}
-
-inline void print_sudoku(const array<Domain>& D, int N) {
-    for (int i = 0; i < N * N * N * N; i++) {
-        if (i % (N * N) == 0) printf("\n");
-        if (D[i].count == 1)
-            printf(" %d", D[i][0]);
-        else
-            printf(" -");
+    buffered_writer writer(file);
+    auto            batch = corpus_batch{&corpus, &writer};
+    auto            stats = search_stats{};
+    if (corpus.lines.count > 0) {
+        CSP  csp             = make_sudoku(corpus.N);
+        auto options         = batch_options{};
+        options.num_threads  = num_threads;
+        options.data         = &batch;
+        options.get_instance = [](long long i, array<Domain>& domains,
+                                  void* data) {
+            auto& corpus = *((corpus_batch*)data)->corpus;
+            if (i >= corpus.lines.count) return false;
+            read_sudoku(corpus, i, domains);
+            return true;
+        };
+        options.on_solution = [](long long, const Assignment& solution,
+                                 void* data) {
+            auto& batch = *(corpus_batch*)data;
+            write_sudoku(*batch.writer, solution);
+            if (solution.count > 0) batch.solved += 1;
+        };
+        solve_batch(csp, options, stats);
     }
-    printf("\n");
-}
+    flush(writer);
+    if (output) fclose(file);
 
-array<Domain> make_sudoku_hard() {
-    return parse_sudoku(
-        " 8 - - - - - - - -"
-        " - - 3 6 - - - - -"
-        " - 7 - - 9 - 2 - -"
-        " - 5 - - - 7 - - -"
-        " - - - - 4 5 7 - -"
-        " - - - 1 - - - 3 -"
-        " - - 1 - - - - 6 8"
-        " - - 8 5 - - - 1 -"
-        " - 9 - - - - 4 - -",
-        3);
+    auto seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+    fprintf(stderr, "Solved %lld of %d sudokus in %.3f s\n", batch.solved,
+            corpus.lines.count, seconds);
+    return 0;
 }
 
+// Usage: sudoku, or sudoku corpus file [threads] [output]
 int main(int argc, char const* argv[]) {
     int  N              = 3;
-    auto arena          = memory_arena(1e6);
+    auto arena          = memory_arena(1 << 20);
     default_allocator() = stack_allocator{&arena, 0};
 
+    if (argc >= 3 and strcmp(argv[1], "corpus") == 0) {
+        int  num_threads = argc >= 4 ? atoi(argv[3]) : 1;
+        auto output      = argc >= 5 ? argv[4] : nullptr;
+        if (num_threads < 1) {
+            fprintf(stderr, "Usage: sudoku corpus file [threads] [output], "
+                            "with at least one thread\n");
+            return 1;
+        }
+        return solve_corpus(argv[2], num_threads, output);
+    }
+
     CSP  csp  = make_sudoku(N);
     auto init = make_sudoku_hard();
     print_sudoku(init, N);
 
+    csp.domains = init;
+
     search_stats stats;
-    auto         success = search(csp.constraints, init, 0, stats);
+    auto         solution = search(csp, {}, stats);
+    apply_assignment(init, solution);
     print_sudoku(init, N);
     print_stats(stats);
 }
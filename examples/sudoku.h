@@ -0,0 +1,179 @@
+#pragma once
+#include <string.h>
+
+#include <thread>
+#include <vector>
+
+#include "../csp.h"
+#include "../utils/buffered_writer.h"
+#include "../utils/mapped_file.h"
+
+inline CSP make_sudoku(int N) {
+    auto domains = allocate<Domain>(N * N * N * N);
+    for (auto& d : domains) d = make_domain(1, N * N + 1);
+
+    auto num_constraints = 3 * N * N;
+    CSP  sudoku          = make_csp("Sudoku", domains, num_constraints);
+
+    auto row   = allocate<int>(N * N);
+    auto col   = allocate<int>(N * N);
+    auto block = allocate<int>(N * N);
+    for (int k = 0; k < N * N; ++k) {
+        int block_start = (k / N) * (N * N * N) + (k % N) * N;
+        for (int i = 0; i < N * N; ++i) {
+            row[i]   = k * N * N + i;
+            col[i]   = i * N * N + k;
+            block[i] = block_start + (i / N) * N * N + i % N;
+        }
+        auto gac = Constraint::DOMAIN_CONSISTENCY;
+        sudoku.constraints.push_back(all_different(row, "row_diff", gac));
+        sudoku.constraints.push_back(all_different(col, "col_diff", gac));
+        sudoku.constraints.push_back(all_different(block, "block_diff", gac));
+    }
+    finalize_csp(sudoku);
+
+    return sudoku;
+}
+
+// Cells are preceded by a space, with '-' for the empty ones. Values above 9
+// are letters, from A for 10.
+inline array<Domain> parse_sudoku(const string& s, int N) {
+    auto A = allocate<Domain>(N * N * N * N);
+    for (int i = 0; i < N * N * N * N; i++) {
+        int  idx = i * 2 + 1;
+        char c   = s[idx];
+        A[i]     = make_domain(1, N * N + 1);
+        if (c != '-') fix(A[i], c <= '9' ? c - '0' : c - 'A' + 10);
+    }
+
+    return A;
+}
+
+inline void print_sudoku(const array<Domain>& D, int N) {
+    for (int i = 0; i < N * N * N * N; i++) {
+        if (i % (N * N) == 0) printf("\n");
+        if (D[i].size() == 1)
+            printf(" %d", D[i].value());
+        else
+            printf(" -");
+    }
+    printf("\n");
+}
+
+inline array<Domain> make_sudoku_hard() {
+    return parse_sudoku(
+        " 8 - - - - - - - -"
+        " - - 3 6 - - - - -"
+        " - 7 - - 9 - 2 - -"
+        " - 5 - - - 7 - - -"
+        " - - - - 4 5 7 - -"
+        " - - - 1 - - - 3 -"
+        " - - 1 - - - - 6 8"
+        " - - 8 5 - - - 1 -"
+        " - 9 - - - - 4 - -",
+        3);
+}
+
+// Value of a cell of the corpus format: digits, then letters from A for 10.
+// Empty cells are '0', '.' or '-'. Returns -1 for any other character.
+inline int sudoku_cell_value(char c) {
+    if (c == '0' or c == '.' or c == '-') return 0;
+    if (c >= '1' and c <= '9') return c - '0';
+    if (c >= 'A' and c <= 'Z') return c - 'A' + 10;
+    if (c >= 'a' and c <= 'z') return c - 'a' + 10;
+    return -1;
+}
+
+// Sudokus of a file with a puzzle per line, a character per cell in the
+// format above: 81 characters for 9x9 puzzles, N^4 for the general ones.
+// Blank lines and the ones starting with '#' are skipped. The file is mapped
+// in memory and read in place, lines holds where each puzzle starts.
+struct sudoku_corpus {
+    mapped_file   file;
+    int           N = 0;  // from the length of the first puzzle
+    array<size_t> lines;
+
+    sudoku_corpus(const char* filename) : file(filename) {}
+};
+
+// Find the puzzles of a corpus, each thread scanning a chunk of the file.
+// Returns false if the file cannot be read, its first puzzle is not a sudoku
+// or there is no thread.
+inline bool index_sudoku_corpus(sudoku_corpus& corpus, int num_threads,
+                                stack_allocator& stack = default_allocator()) {
+    auto data = corpus.file.data;
+    auto size = corpus.file.size;
+    if (data == nullptr or num_threads < 1) return false;
+
+    // Start of the line after position p, or size.
+    auto next_line = [&](size_t p) {
+        auto end = (const char*)memchr(data + p, '\n', size - p);
+        return end ? size_t(end - data) + 1 : size;
+    };
+    auto is_puzzle = [&](size_t p) {
+        return data[p] != '\n' and data[p] != '\r' and data[p] != '#';
+    };
+
+    // A line belongs to the chunk where it starts.
+    auto chunks = std::vector<std::vector<size_t>>(num_threads);
+    auto scan   = [&](int k) {
+        size_t p   = size / num_threads * k;
+        size_t end = k == num_threads - 1 ? size : size / num_threads * (k + 1);
+        if (p > 0 and data[p - 1] != '\n') p = next_line(p);
+        for (; p < end; p = next_line(p))
+            if (is_puzzle(p)) chunks[k].push_back(p);
+    };
+    auto threads = std::vector<std::thread>();
+    for (int k = 0; k < num_threads; ++k) threads.emplace_back(scan, k);
+    for (auto& thread : threads) thread.join();
+
+    int count = 0;
+    for (auto& chunk : chunks) count += (int)chunk.size();
+    corpus.lines       = allocate<size_t>(count, stack);
+    corpus.lines.count = 0;
+    for (auto& chunk : chunks)
+        for (auto p : chunk) corpus.lines.push_back(p);
+    if (count == 0) return true;
+
+    // N^4 cells on the first line.
+    auto first  = corpus.lines[0];
+    auto length = next_line(first) - first;
+    while (length > 0 and (data[first + length - 1] == '\n' or
+                           data[first + length - 1] == '\r'))
+        length -= 1;
+    for (int N = 2; N * N * N * N <= (int)length; ++N)
+        if (N * N * N * N == (int)length) corpus.N = N;
+    return corpus.N > 0;
+}
+
+// Narrow the domains of a sudoku to the clues of puzzle i of a corpus. A
+// malformed line leaves the first domain empty, so it has no solution.
+inline void read_sudoku(const sudoku_corpus& corpus, long long i,
+                        array<Domain>& domains) {
+    int  N     = corpus.N;
+    int  cells = N * N * N * N;
+    auto line  = corpus.file.data + corpus.lines[i];
+    auto left  = corpus.file.size - corpus.lines[i];
+    bool valid = left >= (size_t)cells;
+    for (int k = 0; valid and k < cells; ++k) {
+        int value = sudoku_cell_value(line[k]);
+        valid     = value >= 0 and value <= N * N;
+        if (value > 0 and valid) fix(domains[k], value);
+    }
+    if (valid and left > (size_t)cells)
+        valid = line[cells] == '\n' or line[cells] == '\r';
+    if (valid) return;
+    auto words = domains[0].words();
+    for (int k = 0; k < domains[0].num_words; ++k) words[k] = 0;
+}
+
+// Write a solution as a line of the corpus format, or "no solution".
+inline void write_sudoku(buffered_writer& writer, const Assignment& solution) {
+    if (solution.count == 0) {
+        write_chars(writer, "no solution\n");
+        return;
+    }
+    for (auto& a : solution)
+        write_char(writer, a.value <= 9 ? '0' + a.value : 'A' + a.value - 10);
+    write_char(writer, '\n');
+}
@@ -0,0 +1,294 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "../csp.h"
+
+// Reads a trace written by open_trace() and summarizes the search trees it
+// describes. Nodes are identified by their path of decisions from the root,
+// prefixed by the thread and the run of the search, and are cut at a maximum
+// depth: the deeper decisions count as part of the node where the path is cut.
+
+struct trace_thread_state {
+    int                      run = 0;
+    std::vector<std::string> paths;  // of the decisions of the branch
+};
+
+struct trace_summary {
+    int                      num_variables = 0;
+    std::vector<std::string> names;  // of the constraints
+    int                      max_depth = 0;  // of the paths
+
+    long long events = 0, decisions = 0, failures = 0, wipeouts = 0,
+              backtracks = 0, solutions = 0, restarts = 0;
+    int                    deepest = 0;
+    std::vector<long long> decisions_by_depth, failures_by_depth;
+    std::vector<long long> wipeouts_by_constraint;
+
+    std::unordered_map<int, trace_thread_state> threads;
+    std::unordered_map<std::string, long long>  nodes;  // decisions by path
+};
+
+static void count_at_depth(std::vector<long long>& counts, int depth) {
+    if (depth >= (int)counts.size()) counts.resize(depth + 1, 0);
+    counts[depth] += 1;
+}
+
+static std::string root_path(int thread, int run) {
+    return "thread " + std::to_string(thread) + ";run " + std::to_string(run);
+}
+
+static void read_event(trace_summary& T, int thread, const trace_event& e) {
+    int   type  = e.header & 0xff;
+    int   depth = (int)(e.header >> 8);
+    auto& state = T.threads[thread];
+    T.events += 1;
+    if (depth > T.deepest) T.deepest = depth;
+
+    if (type == trace_event::DECISION) {
+        T.decisions += 1;
+        count_at_depth(T.decisions_by_depth, depth);
+
+        // The branch of parallel_search() tasks starts with decisions that
+        // are not logged.
+        auto& paths = state.paths;
+        if (paths.empty()) paths.push_back(root_path(thread, state.run));
+        while ((int)paths.size() > depth) paths.pop_back();
+        while ((int)paths.size() < depth) paths.push_back(paths.back() + ";?");
+        if (depth <= T.max_depth) {
+            auto label = "x" + std::to_string(e.a) + "=" + std::to_string(e.b);
+            paths.push_back(paths.back() + ";" + label);
+        } else {
+            paths.push_back(paths.back());
+        }
+        T.nodes[paths.back()] += 1;
+    } else if (type == trace_event::PROPAGATION) {
+        if (e.a) return;
+        T.failures += 1;
+        count_at_depth(T.failures_by_depth, depth);
+    } else if (type == trace_event::WIPEOUT) {
+        T.wipeouts += 1;
+        if (e.a >= 0 and e.a < (int)T.wipeouts_by_constraint.size())
+            T.wipeouts_by_constraint[e.a] += 1;
+    } else if (type == trace_event::BACKTRACK) {
+        T.backtracks += 1;
+    } else if (type == trace_event::SOLUTION) {
+        T.solutions += 1;
+    } else if (type == trace_event::RESTART) {
+        T.restarts += 1;
+        state.run   = e.a;
+        state.paths = {root_path(thread, state.run)};
+    }
+}
+
+static bool read_trace(trace_summary& T, const char* filename) {
+    auto file = fopen(filename, "rb");
+    if (not file) {
+        printf("Cannot open %s\n", filename);
+        return false;
+    }
+    uint32_t header[5];
+    if (fread(header, sizeof(header), 1, file) != 1 or
+        memcmp(header, "CSPTRACE", 8) != 0 or header[2] != 1) {
+        printf("%s is not a trace\n", filename);
+        fclose(file);
+        return false;
+    }
+    T.num_variables = header[3];
+    T.names.resize(header[4]);
+    T.wipeouts_by_constraint.resize(header[4], 0);
+    for (auto& name : T.names) {
+        int c;
+        while ((c = fgetc(file)) > 0) name += (char)c;
+    }
+
+    // Blocks of events, one at a time.
+    auto events = std::vector<trace_event>();
+    uint32_t block[2];
+    while (fread(block, sizeof(block), 1, file) == 1) {
+        events.resize(block[1]);
+        if (fread(events.data(), sizeof(trace_event), block[1], file) !=
+            block[1]) {
+            printf("%s is truncated\n", filename);
+            break;
+        }
+        for (auto& e : events) read_event(T, (int)block[0], e);
+    }
+    fclose(file);
+    return true;
+}
+
+static std::string parent_of(const std::string& path) {
+    auto end = path.rfind(';');
+    return end == std::string::npos ? std::string() : path.substr(0, end);
+}
+
+static int depth_of(const std::string& path) {
+    return (int)std::count(path.begin(), path.end(), ';') - 1;
+}
+
+static double percent(long long part, long long total) {
+    return total == 0 ? 0.0 : 100.0 * part / total;
+}
+
+static void print_summary(const trace_summary& T) {
+    printf("Trace of %d variables, %d constraints, %d threads\n",
+           T.num_variables, (int)T.names.size(), (int)T.threads.size());
+    printf("   events     = %lld\n", T.events);
+    printf("   decisions  = %lld\n", T.decisions);
+    printf("   failures   = %lld\n", T.failures);
+    printf("   wipeouts   = %lld\n", T.wipeouts);
+    printf("   backtracks = %lld\n", T.backtracks);
+    printf("   solutions  = %lld\n", T.solutions);
+    printf("   restarts   = %lld\n", T.restarts);
+    printf("   max_depth  = %d\n\n", T.deepest);
+
+    printf("Nodes by depth:\n");
+    printf("   %5s %12s %12s %8s\n", "depth", "decisions", "failures",
+           "failed");
+    for (int d = 0; d < (int)T.decisions_by_depth.size(); ++d) {
+        auto decisions = T.decisions_by_depth[d];
+        auto failures  = d < (int)T.failures_by_depth.size()
+                             ? T.failures_by_depth[d]
+                             : 0;
+        if (decisions == 0) continue;
+        printf("   %5d %12lld %12lld %7.1f%%\n", d, decisions, failures,
+               percent(failures, decisions));
+    }
+    printf("\n");
+
+    auto order = std::vector<int>(T.names.size());
+    for (int c = 0; c < (int)order.size(); ++c) order[c] = c;
+    std::sort(order.begin(), order.end(), [&](int a, int b) {
+        return T.wipeouts_by_constraint[a] > T.wipeouts_by_constraint[b];
+    });
+    printf("Constraints that failed most:\n");
+    for (int i = 0; i < (int)order.size() and i < 10; ++i) {
+        int c = order[i];
+        if (T.wipeouts_by_constraint[c] == 0) break;
+        printf("   %12lld  %s (%d)\n", T.wipeouts_by_constraint[c],
+               T.names[c].c_str(), c);
+    }
+    printf("\n");
+}
+
+// Size of the subtree of each node, and the children of each one.
+struct trace_tree {
+    std::unordered_map<std::string, long long>                subtree;
+    std::unordered_map<std::string, std::vector<std::string>> children;
+};
+
+static trace_tree make_tree(const trace_summary& T) {
+    auto tree = trace_tree{};
+    for (auto& node : T.nodes) {
+        auto path = node.first;
+        while (not path.empty()) {
+            if (tree.subtree.count(path) == 0) {
+                auto parent = parent_of(path);
+                if (not parent.empty()) tree.children[parent].push_back(path);
+            }
+            tree.subtree[path] += node.second;
+            path = parent_of(path);
+        }
+    }
+    return tree;
+}
+
+// The subtrees that are much larger than the ones of their siblings, and the
+// branch through the largest subtree at each depth.
+static void print_blowups(const trace_summary& T, const trace_tree& tree) {
+    struct blowup {
+        std::string path;
+        double      ratio;
+    };
+    auto blowups = std::vector<blowup>();
+    for (auto& node : tree.children) {
+        auto& children = node.second;
+        if (children.size() < 2 or depth_of(node.first) < 0) continue;
+        // Nodes below the parent, without its own decision.
+        auto      self  = T.nodes.find(node.first);
+        long long total = tree.subtree.at(node.first);
+        if (self != T.nodes.end()) total -= self->second;
+        for (auto& child : children) {
+            auto size   = tree.subtree.at(child);
+            auto others = (double)(total - size) / (children.size() - 1);
+            if (size * 100 < T.decisions) continue;  // less than 1%
+            blowups.push_back({child, size / std::max(others, 1.0)});
+        }
+    }
+    std::sort(blowups.begin(), blowups.end(), [](const blowup& a,
+                                                 const blowup& b) {
+        return a.ratio > b.ratio;
+    });
+    printf("Subtrees larger than their siblings, with 1%% of the nodes:\n");
+    printf("   %8s %12s %8s  %s\n", "ratio", "nodes", "share", "path");
+    for (int i = 0; i < (int)blowups.size() and i < 10; ++i) {
+        auto& b    = blowups[i];
+        auto  size = tree.subtree.at(b.path);
+        printf("   %8.1f %12lld %7.1f%%  %s\n", b.ratio, size,
+               percent(size, T.decisions), b.path.c_str());
+    }
+    printf("\n");
+
+    // From the largest run of the largest thread.
+    auto roots = std::vector<std::string>();
+    for (auto& node : tree.subtree)
+        if (depth_of(node.first) == 0) roots.push_back(node.first);
+    if (roots.empty()) return;
+    auto largest = [&](const std::vector<std::string>& nodes) {
+        return *std::max_element(nodes.begin(), nodes.end(),
+                                 [&](const std::string& a,
+                                     const std::string& b) {
+                                     return tree.subtree.at(a) <
+                                            tree.subtree.at(b);
+                                 });
+    };
+    auto path = largest(roots);
+    printf("Heaviest branch of %s:\n", path.c_str());
+    printf("   %5s %12s %8s %8s  %s\n", "depth", "nodes", "share", "siblings",
+           "decision");
+    while (tree.children.count(path)) {
+        auto& children = tree.children.at(path);
+        auto  parent   = tree.subtree.at(path);
+        path           = largest(children);
+        auto size      = tree.subtree.at(path);
+        printf("   %5d %12lld %7.1f%% %8d  %s\n", depth_of(path), size,
+               percent(size, parent), (int)children.size() - 1,
+               path.substr(path.rfind(';') + 1).c_str());
+    }
+    printf("\n");
+}
+
+// One line per node with the number of decisions it accounts for, in the
+// folded format read by flame graph tools.
+static void print_folded(const trace_summary& T) {
+    auto paths = std::vector<std::string>();
+    for (auto& node : T.nodes) paths.push_back(node.first);
+    std::sort(paths.begin(), paths.end());
+    for (auto& path : paths)
+        printf("%s %lld\n", path.c_str(), T.nodes.at(path));
+}
+
+// Usage: csp_trace file [summary|folded] [max_depth]
+int main(int argc, char const* argv[]) {
+    if (argc < 2) {
+        printf("Usage: csp_trace file [summary|folded] [max_depth]\n");
+        return 1;
+    }
+    bool folded = argc >= 3 and strcmp(argv[2], "folded") == 0;
+
+    auto T      = trace_summary{};
+    T.max_depth = argc >= 4 ? atoi(argv[3]) : 16;
+    if (not read_trace(T, argv[1])) return 1;
+
+    if (folded) {
+        print_folded(T);
+        return 0;
+    }
+    print_summary(T);
+    print_blowups(T, make_tree(T));
+}
@@ -2,6 +2,7 @@
 #define GIACOMO_ARRAY
 
 #include <stdio.h>
+#include <stdlib.h>
 
 #include <cassert>
 #include <initializer_list>
@@ -184,6 +185,33 @@ inline int argmax(const array<int>& arr) {
     return max_index;
 }
 
+// sort array in place (heapsort), less(a, b) tells if a must come before b
+template <typename Type, typename Less>
+inline void sort(array<Type>& arr, const Less& less) {
+    auto sift_down = [&](int i, int count) {
+        while (true) {
+            int largest = i;
+            int left    = 2 * i + 1;
+            int right   = 2 * i + 2;
+            if (left < count and less(arr[largest], arr[left])) largest = left;
+            if (right < count and less(arr[largest], arr[right]))
+                largest = right;
+            if (largest == i) return;
+            Type tmp     = arr[i];
+            arr[i]       = arr[largest];
+            arr[largest] = tmp;
+            i            = largest;
+        }
+    };
+    for (int i = arr.count / 2 - 1; i >= 0; --i) sift_down(i, arr.count);
+    for (int last = arr.count - 1; last > 0; --last) {
+        Type tmp  = arr[0];
+        arr[0]    = arr[last];
+        arr[last] = tmp;
+        sift_down(0, last);
+    }
+}
+
 inline void shuffle(array<int>& arr) {
     for (int i = arr.count - 1; i > 0; --i) {
         int j   = rand() % (i + 1);
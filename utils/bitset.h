@@ -0,0 +1,45 @@
+#ifndef GIACOMO_BITSET
+#define GIACOMO_BITSET
+
+#include <stdint.h>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace giacomo {
+
+/* Helpers to work with bitsets stored as arrays of 64-bit words. Bit i lives
+ * in word i / 64 at position i % 64. */
+
+inline int num_words(int num_bits) { return (num_bits + 63) / 64; }
+
+inline uint64_t bit(int i) { return uint64_t(1) << (i & 63); }
+
+#if defined(_MSC_VER)
+inline int popcount(uint64_t word) { return (int)__popcnt64(word); }
+
+inline int count_trailing_zeros(uint64_t word) {
+    unsigned long index;
+    _BitScanForward64(&index, word);
+    return (int)index;
+}
+
+inline int count_leading_zeros(uint64_t word) {
+    unsigned long index;
+    _BitScanReverse64(&index, word);
+    return 63 - (int)index;
+}
+#else
+inline int popcount(uint64_t word) { return __builtin_popcountll(word); }
+
+// undefined for word == 0
+inline int count_trailing_zeros(uint64_t word) { return __builtin_ctzll(word); }
+
+// undefined for word == 0
+inline int count_leading_zeros(uint64_t word) { return __builtin_clzll(word); }
+#endif
+
+}  // namespace giacomo
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef GIACOMO_BUFFERED_WRITER
+#define GIACOMO_BUFFERED_WRITER
+
+#include <stdio.h>
+#include <string.h>
+
+namespace giacomo {
+
+/* buffered_writer collects small writes, such as the cells of a grid, and
+ * hands them to the file in large blocks. The rest is written by flush() or
+ * on destruction. */
+
+const int writer_buffer_size = 1 << 16;
+
+struct buffered_writer {
+    FILE* file;
+    int   count = 0;
+    char  buffer[writer_buffer_size];
+
+    buffered_writer(FILE* f) : file(f) {}
+    ~buffered_writer() {
+        if (count > 0) fwrite(buffer, 1, count, file);
+    }
+};
+
+inline void flush(buffered_writer& writer) {
+    if (writer.count > 0) fwrite(writer.buffer, 1, writer.count, writer.file);
+    writer.count = 0;
+}
+
+inline void write_char(buffered_writer& writer, char c) {
+    if (writer.count == writer_buffer_size) flush(writer);
+    writer.buffer[writer.count++] = c;
+}
+
+inline void write_chars(buffered_writer& writer, const char* s, int n) {
+    if (writer.count + n > writer_buffer_size) flush(writer);
+    if (n > writer_buffer_size) {
+        fwrite(s, 1, n, writer.file);
+        return;
+    }
+    memcpy(writer.buffer + writer.count, s, n);
+    writer.count += n;
+}
+
+inline void write_chars(buffered_writer& writer, const char* s) {
+    write_chars(writer, s, (int)strlen(s));
+}
+
+}  // namespace giacomo
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef GIACOMO_CYCLES
+#define GIACOMO_CYCLES
+
+#include <stdint.h>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+
+namespace giacomo {
+
+/* Cheap timestamp to measure short sections of code: the time stamp counter
+ * on x86, the virtual counter on ARM, nanoseconds elsewhere. Only differences
+ * between readings of the same thread are meaningful. */
+
+inline uint64_t read_cycles() {
+#if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#elif defined(__aarch64__)
+    uint64_t value;
+    asm volatile("mrs %0, cntvct_el0" : "=r"(value));
+    return value;
+#else
+    auto now = std::chrono::steady_clock::now().time_since_epoch();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+#endif
+}
+
+// Adds the cycles spent in its scope to a counter.
+struct cycle_timer {
+    uint64_t& counter;
+    uint64_t  start;
+
+    cycle_timer(uint64_t& c) : counter(c), start(read_cycles()) {}
+    ~cycle_timer() { counter += read_cycles() - start; }
+};
+
+}  // namespace giacomo
+
+#endif
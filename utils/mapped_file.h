@@ -0,0 +1,84 @@
+#ifndef GIACOMO_MAPPED_FILE
+#define GIACOMO_MAPPED_FILE
+
+#include <stddef.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace giacomo {
+
+/* mapped_file maps a whole file in memory, read only, so it can be read in
+ * place by several threads without copying it. The pages are loaded by the
+ * system as they are touched. data is nullptr if the file cannot be mapped,
+ * and points to an empty string for an empty file. */
+
+struct mapped_file {
+    const char* data = nullptr;
+    size_t      size = 0;
+
+    mapped_file(const char* filename) {
+#if defined(_WIN32)
+        auto file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ,
+                                nullptr, OPEN_EXISTING,
+                                FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE) return;
+        LARGE_INTEGER file_size;
+        if (GetFileSizeEx(file, &file_size) and file_size.QuadPart == 0) {
+            data = "";
+        } else if (file_size.QuadPart > 0) {
+            auto mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0,
+                                              0, nullptr);
+            if (mapping != nullptr) {
+                auto view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+                if (view != nullptr) {
+                    data = (const char*)view;
+                    size = (size_t)file_size.QuadPart;
+                }
+                CloseHandle(mapping);
+            }
+        }
+        CloseHandle(file);
+#else
+        int file = open(filename, O_RDONLY);
+        if (file == -1) return;
+        struct stat info;
+        if (fstat(file, &info) != 0) info.st_size = -1;
+        if (info.st_size == 0) {
+            data = "";
+        } else if (info.st_size > 0) {
+            auto view = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE,
+                             file, 0);
+            if (view != MAP_FAILED) {
+                madvise(view, info.st_size, MADV_SEQUENTIAL);
+                data = (const char*)view;
+                size = (size_t)info.st_size;
+            }
+        }
+        close(file);
+#endif
+    }
+
+    ~mapped_file() {
+        if (size == 0) return;
+#if defined(_WIN32)
+        UnmapViewOfFile(data);
+#else
+        munmap((void*)data, size);
+#endif
+    }
+
+   private:
+    mapped_file(const mapped_file&);
+    mapped_file& operator=(const mapped_file&);
+};
+
+}  // namespace giacomo
+
+#endif
@@ -1,35 +1,105 @@
 #ifndef GIACOMO_MEMORY_ARENA
 #define GIACOMO_MEMORY_ARENA
+
+#include <stddef.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
 namespace giacomo {
 
 using byte = unsigned char;
 
+/* memory_arena reserves a large range of virtual memory up front and commits
+ * it in chunks as it grows, so the data never moves and pointers into the
+ * arena stay valid. Memory left unused is given back to the system with
+ * shrink_memory_arena(). */
+
+// Granularity of committed memory.
+const size_t arena_chunk_size = size_t(1) << 16;
+
+// Address space reserved by default, only committed memory is backed.
+const size_t arena_reserve_size = sizeof(void*) == 8 ? size_t(1) << 36
+                                                     : size_t(1) << 30;
+
+inline size_t round_up_to_chunk(size_t bytes) {
+    return (bytes + arena_chunk_size - 1) / arena_chunk_size * arena_chunk_size;
+}
+
+inline byte* reserve_memory(size_t bytes) {
+#if defined(_WIN32)
+    return (byte*)VirtualAlloc(nullptr, bytes, MEM_RESERVE, PAGE_NOACCESS);
+#else
+    auto flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE;
+    auto data  = mmap(nullptr, bytes, PROT_NONE, flags, -1, 0);
+    return data == MAP_FAILED ? nullptr : (byte*)data;
+#endif
+}
+
+inline void release_memory(byte* data, size_t bytes) {
+#if defined(_WIN32)
+    VirtualFree(data, 0, MEM_RELEASE);
+#else
+    munmap(data, bytes);
+#endif
+}
+
+inline bool commit_memory(byte* data, size_t bytes) {
+#if defined(_WIN32)
+    return VirtualAlloc(data, bytes, MEM_COMMIT, PAGE_READWRITE) != nullptr;
+#else
+    return mprotect(data, bytes, PROT_READ | PROT_WRITE) == 0;
+#endif
+}
+
+inline void decommit_memory(byte* data, size_t bytes) {
+#if defined(_WIN32)
+    VirtualFree(data, bytes, MEM_DECOMMIT);
+#else
+    madvise(data, bytes, MADV_DONTNEED);
+    mprotect(data, bytes, PROT_NONE);
+#endif
+}
+
 struct memory_arena {
     byte*  data;
-    size_t capacity;
-
-    memory_arena(size_t n) {
-        // allocate memory on initialization
-        data = new byte[n];
-        if (data == nullptr)
-            capacity = 0;
-        else
-            capacity = n;
+    size_t capacity;  // committed bytes
+    size_t reserved;  // reserved bytes, the limit of capacity
+
+    // Committed memory beyond this much more than is used is given back.
+    size_t release_threshold = size_t(1) << 24;
+
+    memory_arena(size_t n, size_t reserve = arena_reserve_size) {
+        // reserve address space and commit the first n bytes
+        capacity = 0;
+        reserved = round_up_to_chunk(n > reserve ? n : reserve);
+        data     = reserve_memory(reserved);
+        if (data == nullptr) {
+            reserved = 0;
+            return;
+        }
+        if (n > 0 and commit_memory(data, round_up_to_chunk(n)))
+            capacity = round_up_to_chunk(n);
     }
 
     ~memory_arena() {
         // free memory on destruction
-        if (data != nullptr) delete[] data;
+        if (data != nullptr) release_memory(data, reserved);
         data     = nullptr;
         capacity = 0;
+        reserved = 0;
     }
 
     // implicit conversion to raw pointer
     operator void*() const { return data; }
 
    private:
-    memory_arena(const memory_arena& rhs) : memory_arena(rhs.capacity) {
-        for (int i = 0; i < rhs.capacity; i++) data[i] = rhs.data[i];
+    memory_arena(const memory_arena& rhs)
+        : memory_arena(rhs.capacity, rhs.reserved) {
+        for (size_t i = 0; i < rhs.capacity; i++) data[i] = rhs.data[i];
     }
     friend inline memory_arena copy(memory_arena& rhs);
 };
@@ -40,24 +110,25 @@ inline bool grow_memory_arena(memory_arena& arena, size_t capacity) {
     // If there is no need to grow, return success
     if (capacity <= arena.capacity) return true;
 
-    // allocate new memory, if something goes wrong return failure
-    auto data = new byte[capacity];
-    if (data == nullptr) return false;
-
-    // copy data from old location to new one
-    for (int i = 0; i < arena.capacity; ++i) data[i] = arena.data[i];
-
-    // free old memory
-    if (arena.data) delete[] arena.data;
+    // commit more of the reserved range, the data stays where it is
+    capacity = round_up_to_chunk(capacity);
+    if (capacity > arena.reserved) return false;
+    auto bytes = capacity - arena.capacity;
+    if (not commit_memory(arena.data + arena.capacity, bytes)) return false;
 
-    // update members
-    arena.data     = data;
     arena.capacity = capacity;
-
-    // return success
     return true;
 }
 
+// Give back to the system the committed memory beyond the first used bytes,
+// keeping half of the release threshold to avoid committing it again soon.
+inline void shrink_memory_arena(memory_arena& arena, size_t used) {
+    auto keep = round_up_to_chunk(used + arena.release_threshold / 2);
+    if (keep >= arena.capacity) return;
+    decommit_memory(arena.data + keep, arena.capacity - keep);
+    arena.capacity = keep;
+}
+
 }  // namespace giacomo
 
 #endif
@@ -0,0 +1,44 @@
+#ifndef GIACOMO_RANDOM
+#define GIACOMO_RANDOM
+
+#include <stdint.h>
+
+#include "array.h"
+
+namespace giacomo {
+
+/* Seeded pseudo-random generator (splitmix64). Unlike rand(), every user owns
+ * its state, so the same seed gives the same sequence, also when other
+ * generators are used by other threads. */
+
+struct rng {
+    uint64_t state;
+};
+
+inline rng make_rng(uint64_t seed) { return rng{seed}; }
+
+inline uint64_t next(rng& random) {
+    uint64_t z = (random.state += 0x9e3779b97f4a7c15);
+    z          = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z          = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    return z ^ (z >> 31);
+}
+
+// random integer in [0, n)
+inline int random_int(rng& random, int n) {
+    return (int)(next(random) % (uint64_t)n);
+}
+
+// shuffle array with the given generator
+inline void shuffle(array<int>& arr, rng& random) {
+    for (int i = arr.count - 1; i > 0; --i) {
+        int j   = random_int(random, i + 1);
+        int tmp = arr[i];
+        arr[i]  = arr[j];
+        arr[j]  = tmp;
+    }
+}
+
+}  // namespace giacomo
+
+#endif
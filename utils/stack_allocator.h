@@ -4,12 +4,15 @@
 
 namespace giacomo {
 /* stack_allocator handles memory allocation. It allows to allocate data
- * incrementally on a stack, which is a pre-allocated memory arena. By using the
- * helper struct stack_frame, memory deallocation is automatic */
+ * incrementally on a stack, which is a memory arena that grows in place. By
+ * using the helper struct stack_frame, memory deallocation is automatic, and
+ * memory left unused by the frames that unwound goes back to the system once
+ * it exceeds the release threshold of the arena */
 
 struct stack_allocator {
     memory_arena* arena;
     size_t        head;
+    size_t        peak = 0;  // highest head reached
 
     byte*       data() { return arena->data; }
     const byte* data() const { return arena->data; }
@@ -20,27 +23,43 @@ struct stack_frame {
     size_t           start;
 
     stack_frame(stack_allocator& s) : stack(s), start(stack.head) {}
-    ~stack_frame() { stack.head = start; }
+    ~stack_frame() {
+        stack.head = start;
+        auto arena = stack.arena;
+        if (arena and arena->capacity - start > arena->release_threshold)
+            shrink_memory_arena(*arena, start);
+    }
 };
 
+// Allocator used when none is given. Every thread has its own, so threads
+// that set it to their own arena can work at the same time.
 inline stack_allocator& default_allocator() {
-    static stack_allocator _default_allocator;
+    static thread_local stack_allocator _default_allocator;
     return _default_allocator;
 }
 
-// allocate chosen amount of bytes
-inline byte* allocate_bytes(size_t bytes, stack_allocator& stack) {
+// allocate chosen amount of bytes, aligned to alignment
+inline byte* allocate_bytes(size_t bytes, stack_allocator& stack,
+                            size_t alignment = alignof(max_align_t)) {
     assert(stack.arena->data != nullptr);
 
+    auto start    = (stack.head + alignment - 1) / alignment * alignment;
+    auto end      = start + bytes;
     auto capacity = stack.arena->capacity;
-    while (stack.head + bytes > capacity) {
+    while (end > capacity) {
         capacity = 2 * (capacity + 8);
     }
-    auto success = grow_memory_arena(*stack.arena, capacity);
-    assert(success);
+    if (capacity > stack.arena->reserved) capacity = end;
+    // callers use the memory without checking, so running out is fatal
+    if (not grow_memory_arena(*stack.arena, capacity)) {
+        fprintf(stderr, "Out of memory: cannot grow the arena to %zu bytes\n",
+                capacity);
+        abort();
+    }
 
-    auto pointer = stack.arena->data + stack.head;
-    stack.head += bytes;
+    auto pointer = stack.arena->data + start;
+    stack.head   = end;
+    if (end > stack.peak) stack.peak = end;
     return pointer;
 }
 
@@ -78,7 +97,7 @@ inline array<array<Type>> copy(const array<array<Type>>& arr,
 
 template <typename Type>
 inline Type& allocate(stack_allocator& stack) {
-    return *(Type*)allocate_bytes(sizeof(Type), stack);
+    return *(Type*)allocate_bytes(sizeof(Type), stack, alignof(Type));
 }
 
 template <typename Type>
@@ -86,7 +105,7 @@ inline array<Type> allocate(int count, stack_allocator& stack) {
     int         bytes = sizeof(Type) * count;
     array<Type> result;
     result.count = count;
-    result.data  = (Type*)allocate_bytes(bytes, stack);
+    result.data  = (Type*)allocate_bytes(bytes, stack, alignof(Type));
     return result;
 }
 
@@ -133,3 +152,4 @@ inline array<array<Type>> copy(const array<array<Type>>& arr,
 }  // namespace giacomo
 
 #define stack_frame() auto _frame = stack_frame(default_allocator());
+#define stack_frame_on(stack) giacomo::stack_frame _frame(stack);